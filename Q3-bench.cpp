@@ -0,0 +1,282 @@
+/**
+ * @file Q3-bench.cpp
+ * @brief Google Benchmark suite for the hot paths of Q3-mm23b009.cpp
+ *
+ * Build and run (see Q3.md):
+ *   g++ -std=c++20 -O2 -pthread ./Q3-bench.cpp -lbenchmark -o ./bench && ./bench
+ *
+ * Benchmarks are parameterised by instrument count, subscriber count and hit
+ * ratio (the percentage of requests whose subscriber is actually subscribed),
+ * and all inputs come from a fixed seed so runs are comparable.
+ */
+
+#define RAVEN_NO_MAIN
+#include "Q3-mm23b009.cpp"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+namespace {
+
+constexpr size_t kRequestCount = 1 << 14;
+
+struct Request {
+    SubscriberHandle subscriber;
+    uint64_t instrumentId;
+};
+
+/**
+ * @brief Subscribes `subscribers` handles to a publisher's instruments and
+ * builds a request stream in which `hitPercent` of the requests are entitled
+ */
+std::vector<Request> make_requests(Publisher& publisher, uint64_t firstId, uint64_t instruments,
+                                   uint32_t subscribers, unsigned hitPercent) {
+    std::mt19937_64 random(42);
+    std::vector<Request> requests;
+    requests.reserve(kRequestCount);
+    for (size_t i = 0; i < kRequestCount; ++i) {
+        const Request request{static_cast<SubscriberHandle>(random() % subscribers), firstId + random() % instruments};
+        if (random() % 100 < hitPercent) publisher.subscribe(request.subscriber, request.instrumentId);
+        requests.push_back(request);
+    }
+    for (uint64_t id = firstId; id < firstId + instruments; ++id) {
+        publisher.update_data(id, price_from_double(100.0 + id), price_from_double(2.5));
+    }
+    return requests;
+}
+
+void instrument_args(benchmark::internal::Benchmark* benchmark) {
+    for (int64_t instruments : {16, 1000}) benchmark->Arg(instruments);
+}
+
+void request_args(benchmark::internal::Benchmark* benchmark) {
+    benchmark->ArgNames({"instruments", "subscribers", "hit%"});
+    for (int64_t instruments : {16, 1000}) {
+        for (int64_t subscribers : {16, 4096}) {
+            for (int64_t hit : {10, 90}) benchmark->Args({instruments, subscribers, hit});
+        }
+    }
+}
+
+void BM_EquityUpdateData(benchmark::State& state) {
+    EquityPublisher publisher;
+    const uint64_t instruments = state.range(0);
+    const Price price = price_from_double(1501449788.0);
+    const Price volume = price_from_double(1682366923.0);
+    uint64_t id = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(publisher.update_data(id, price, volume));
+        if (++id == instruments) id = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EquityUpdateData)->Apply(instrument_args)->ArgName("instruments");
+
+void BM_BondGetData(benchmark::State& state) {
+    BondPublisher publisher;
+    const auto requests = make_requests(publisher, 1000, state.range(0), state.range(1), state.range(2));
+    Quote quote;
+    size_t next = 0;
+    for (auto _ : state) {
+        const Request& request = requests[next++ % kRequestCount];
+        benchmark::DoNotOptimize(publisher.get_data(request.subscriber, request.instrumentId, quote));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BondGetData)->Apply(request_args);
+
+/// One subscriber entitled to every instrument; batch:1 is the one-call-per-instrument baseline.
+void BM_BondGetDataBatch(benchmark::State& state) {
+    BondPublisher publisher;
+    const size_t batchSize = state.range(1);
+    std::mt19937_64 random(42);
+    std::vector<uint64_t> ids(kRequestCount);
+    for (uint64_t& id : ids) id = 1000 + random() % state.range(0);
+    for (uint64_t id = 1000; id < 1000 + static_cast<uint64_t>(state.range(0)); ++id) {
+        publisher.subscribe(0, id);
+        publisher.update_data(id, price_from_double(100.0 + id), price_from_double(2.5));
+    }
+
+    std::vector<LookupResult> results(batchSize);
+    size_t next = 0;
+    for (auto _ : state) {
+        publisher.get_data_batch(0, std::span(ids).subspan(next, batchSize), results);
+        benchmark::DoNotOptimize(results.data());
+        next = (next + batchSize) % kRequestCount;
+    }
+    state.SetItemsProcessed(state.iterations() * batchSize);
+}
+BENCHMARK(BM_BondGetDataBatch)->ArgNames({"instruments", "batch"})->ArgsProduct({{16, 1000}, {1, 16, 256}});
+
+void BM_PublisherSubscribe(benchmark::State& state) {
+    const uint64_t instruments = state.range(0);
+    const uint32_t subscribers = state.range(1);
+    std::mt19937_64 random(42);
+    std::vector<Request> requests(kRequestCount);
+    for (Request& request : requests) {
+        request = {static_cast<SubscriberHandle>(random() % subscribers), random() % instruments};
+    }
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        EquityPublisher publisher;
+        state.ResumeTiming();
+        for (const Request& request : requests) {
+            benchmark::DoNotOptimize(publisher.subscribe(request.subscriber, request.instrumentId));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kRequestCount);
+}
+BENCHMARK(BM_PublisherSubscribe)
+    ->ArgNames({"instruments", "subscribers"})
+    ->ArgsProduct({{16, 1000}, {16, 4096}});
+
+/// Includes formatting into an in-memory sink; each subscriber is replaced
+/// after 100 requests so the free quota never runs out.
+void BM_FreeSubscriberGetData(benchmark::State& state) {
+    std::shared_ptr<Publisher> publisher = std::make_shared<EquityPublisher>();
+    const auto requests = make_requests(*publisher, 0, state.range(0), state.range(1), state.range(2));
+    std::vector<std::unique_ptr<FreeSubscriber>> subscribers(state.range(1));
+    for (uint32_t handle = 0; handle < subscribers.size(); ++handle) {
+        subscribers[handle] = std::make_unique<FreeSubscriber>(handle, std::to_string(handle));
+    }
+
+    std::vector<unsigned> requestsMade(subscribers.size());
+
+    OutputSink out(OutputSink::kMemory);
+    size_t next = 0;
+    for (auto _ : state) {
+        const Request& request = requests[next++ % kRequestCount];
+        auto& subscriber = subscribers[request.subscriber];
+        if (++requestsMade[request.subscriber] % 100 == 0) {
+            subscriber = std::make_unique<FreeSubscriber>(request.subscriber, std::to_string(request.subscriber));
+        }
+        subscriber->get_data(publisher, request.instrumentId, out);
+        if (out.contents().size() > (1 << 20)) out.clear();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FreeSubscriberGetData)->Apply(request_args);
+
+/// Build with -DRAVEN_COLUMNAR_INSTRUMENTS to compare the struct-of-arrays store.
+void BM_PriceSummary(benchmark::State& state) {
+    EquityPublisher publisher;
+    for (uint64_t id = 0; id < static_cast<uint64_t>(state.range(0)); ++id) {
+        publisher.update_data(id, price_from_double(100.0 + id), price_from_double(2.5));
+    }
+    for (auto _ : state) benchmark::DoNotOptimize(publisher.price_summary());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PriceSummary)->Apply(instrument_args)->ArgName("instruments");
+
+/// Producer on the benchmark thread, consumer draining on a second thread; a ring
+/// smaller than the burst makes the producer overrun it and conflate.
+void BM_DeliveryQueueConcurrent(benchmark::State& state) {
+    constexpr uint64_t kInstruments = 64;
+    DeliveryQueue queue(state.range(0));
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> delivered{0};
+    std::thread consumer([&] {
+        uint64_t count = 0;
+        auto deliver = [&](const InstrumentUpdate&) { ++count; };
+        while (!done.load(std::memory_order_acquire)) {
+            const uint64_t before = count;
+            queue.drain(deliver);
+            if (count == before) std::this_thread::yield();
+        }
+        queue.drain(deliver);
+        delivered.store(count, std::memory_order_relaxed);
+    });
+
+    uint64_t conflated = 0;
+    uint64_t next = 0;
+    for (auto _ : state) {
+        conflated += queue.push({next % kInstruments, Quote{price_from_double(1.0 * next), {}}});
+        ++next;
+    }
+    done.store(true, std::memory_order_release);
+    consumer.join();
+
+    state.SetItemsProcessed(state.iterations());
+    state.counters["conflated%"] = 100.0 * conflated / state.iterations();
+    state.counters["delivered%"] = 100.0 * delivered.load(std::memory_order_relaxed) / state.iterations();
+}
+BENCHMARK(BM_DeliveryQueueConcurrent)->ArgName("ring")->Arg(16)->Arg(256)->UseRealTime();
+
+/// Bursts of four ring-fulls with nobody draining in between, so three quarters of each burst conflates.
+void BM_DeliveryQueueOverrun(benchmark::State& state) {
+    const uint64_t ring = state.range(0);
+    const uint64_t instruments = state.range(1);
+    DeliveryQueue queue(ring);
+    uint64_t conflated = 0;
+    uint64_t delivered = 0;
+    for (auto _ : state) {
+        for (uint64_t i = 0; i < 4 * ring; ++i) conflated += queue.push({i % instruments, Quote{}});
+        queue.drain([&](const InstrumentUpdate&) { ++delivered; });
+    }
+    state.SetItemsProcessed(state.iterations() * 4 * ring);
+    state.counters["conflated%"] = 100.0 * conflated / (state.iterations() * 4 * ring);
+    state.counters["delivered%"] = 100.0 * delivered / (state.iterations() * 4 * ring);
+}
+BENCHMARK(BM_DeliveryQueueOverrun)->ArgNames({"ring", "instruments"})->ArgsProduct({{256}, {16, 1024}});
+
+void BM_ParseCommand(benchmark::State& state) {
+    std::mt19937_64 random(42);
+    std::string text;
+    for (size_t i = 0; i < kRequestCount; ++i) {
+        const uint64_t id = random() % 2000;
+        switch (random() % 3) {
+        case 0:
+            text += "P " + std::to_string(id) + " " + std::to_string(random() % 2000000000) + " " +
+                    std::to_string(random() % 2000000000) + "\n";
+            break;
+        case 1:
+            text += "S P " + std::to_string(random() % 4096) + " subscribe " + std::to_string(id) + "\n";
+            break;
+        default:
+            text += "S F " + std::to_string(random() % 4096) + " get_data " + std::to_string(id) + "\n";
+            break;
+        }
+    }
+
+    FieldScanner scanner;
+    LineFields fields;
+    size_t offset = 0;
+    for (auto _ : state) {
+        const size_t length = scanner.scan(text.data() + offset, text.data() + text.size(), fields);
+        benchmark::DoNotOptimize(parse_command(std::string_view(text.data() + offset, length), fields));
+        offset += length + 1;
+        if (offset >= text.size()) {
+            offset = 0;
+            scanner.reset();
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * text.size() / kRequestCount);
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel(FieldScanner::name());
+}
+BENCHMARK(BM_ParseCommand);
+
+void BM_PrintResult(benchmark::State& state) {
+    const bool binary = state.range(0);
+    PaidSubscriber subscriber(0, "102");
+    const Quote equity{price_from_double(1501449788.0), volume_to_price(1682366923)};
+    const Quote bond{price_from_double(747403339.0), price_from_double(4.25)};
+
+    OutputSink out(OutputSink::kMemory);
+    out.set_binary_responses(binary);
+    uint64_t i = 0;
+    for (auto _ : state) {
+        const bool isBond = i & 1;
+        subscriber.print_result(out, i % 8 != 7, isBond ? 1000 + i % 1000 : i % 1000, isBond ? bond : equity);
+        if (out.contents().size() > (1 << 20)) out.clear();
+        ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PrintResult)->ArgName("binary")->Arg(0)->Arg(1);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,205 @@
+/**
+ * @file Q3-loadgen.cpp
+ * @brief Synthetic command stream generator for Q3-mm23b009.cpp
+ *
+ * Writes a command file in the P/S input format with a configurable
+ * instrument universe, Zipf-distributed instrument popularity, a paid/free
+ * subscriber mix and a command mix, so end-to-end throughput can be measured
+ * on traffic shaped like production rather than on the README example.
+ *
+ * Build and run (see Q3.md):
+ *   g++ -std=c++20 -O2 ./Q3-loadgen.cpp -o ./loadgen
+ *   ./loadgen --lines=1000000 --zipf=1.1 > commands.txt
+ */
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Shape of the generated workload
+ */
+struct LoadProfile {
+    uint64_t lines{100000};
+    uint64_t equities{1000};      // instruments drawn from IDs 0-999
+    uint64_t bonds{1000};         // instruments drawn from IDs 1000-1999
+    double zipfExponent{1.0};     // 0 gives uniform popularity
+    uint64_t subscribers{1000};
+    double freeFraction{0.5};     // share of subscribers on the free tier
+    double updateFraction{0.3};   // share of lines that are P updates
+    double subscribeFraction{0.2};  // share of S lines that are subscribe rather than get_data
+    uint64_t seed{1};
+};
+
+/**
+ * @brief Draws ranks 0..n-1 with probability proportional to 1 / (rank + 1)^s
+ *
+ * The cumulative distribution is tabulated once; each draw is a binary search.
+ */
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t n, double exponent) : cdf_(n) {
+        double total = 0.0;
+        for (size_t rank = 0; rank < n; ++rank) {
+            total += 1.0 / std::pow(static_cast<double>(rank + 1), exponent);
+            cdf_[rank] = total;
+        }
+        for (double& value : cdf_) value /= total;
+    }
+
+    template <typename Random>
+    size_t operator()(Random& random) {
+        const double u = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+        const auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+        return std::min<size_t>(it - cdf_.begin(), cdf_.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf_;
+};
+
+/**
+ * @brief Produces the command lines of one workload
+ *
+ * Instruments are ranked by popularity in a random order, so the hottest
+ * IDs are spread over both asset classes. Each subscriber keeps the same
+ * tier throughout, and get_data requests favour instruments the subscriber
+ * has already subscribed to, as a real client would.
+ */
+class LoadGenerator {
+public:
+    explicit LoadGenerator(const LoadProfile& profile)
+        : profile_(profile), random_(profile.seed), popularity_(profile.equities + profile.bonds, profile.zipfExponent),
+          subscriptions_(profile.subscribers) {
+        for (uint64_t id = 0; id < profile.equities; ++id) instruments_.push_back(id);
+        for (uint64_t id = 0; id < profile.bonds; ++id) instruments_.push_back(1000 + id);
+        std::shuffle(instruments_.begin(), instruments_.end(), random_);
+
+        std::bernoulli_distribution isFree(profile.freeFraction);
+        for (uint64_t i = 0; i < profile.subscribers; ++i) freeTier_.push_back(isFree(random_));
+    }
+
+    void write(std::string& out) {
+        append_number(out, profile_.lines);
+        out += '\n';
+        std::bernoulli_distribution isUpdate(profile_.updateFraction);
+        std::bernoulli_distribution isSubscribe(profile_.subscribeFraction);
+        std::uniform_int_distribution<uint64_t> subscriber(0, profile_.subscribers - 1);
+        std::uniform_int_distribution<uint64_t> price(1, 2'000'000'000);
+
+        for (uint64_t line = 0; line < profile_.lines; ++line) {
+            if (isUpdate(random_)) {
+                out += "P ";
+                append_number(out, pick_instrument());
+                out += ' ';
+                append_number(out, price(random_));
+                out += ' ';
+                append_number(out, price(random_));
+            } else {
+                const uint64_t who = subscriber(random_);
+                std::vector<uint64_t>& owned = subscriptions_[who];
+                out += freeTier_[who] ? "S F " : "S P ";
+                append_number(out, who + 1);
+                if (owned.empty() || isSubscribe(random_)) {
+                    const uint64_t id = pick_instrument();
+                    owned.push_back(id);
+                    out += " subscribe ";
+                    append_number(out, id);
+                } else {
+                    // Mostly instruments already subscribed to; the rest exercise invalid_request.
+                    const bool known = std::bernoulli_distribution(0.9)(random_);
+                    out += " get_data ";
+                    append_number(out, known ? owned[random_() % owned.size()] : pick_instrument());
+                }
+            }
+            out += '\n';
+            if (out.size() >= (1 << 16)) flush(out);
+        }
+    }
+
+    static void flush(std::string& out) {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        out.clear();
+    }
+
+private:
+    uint64_t pick_instrument() { return instruments_[popularity_(random_)]; }
+
+    static void append_number(std::string& out, uint64_t value) {
+        char digits[20];
+        out.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+    }
+
+    LoadProfile profile_;
+    std::mt19937_64 random_;
+    ZipfDistribution popularity_;
+    std::vector<uint64_t> instruments_;
+    std::vector<bool> freeTier_;
+    std::vector<std::vector<uint64_t>> subscriptions_;
+};
+
+template <typename T>
+T parse_value(std::string_view flag, std::string_view text) {
+    T value{};
+    const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+        throw std::invalid_argument(std::string(flag) + ": invalid value '" + std::string(text) + "'");
+    }
+    return value;
+}
+
+LoadProfile parse_profile(int argc, char* argv[]) {
+    LoadProfile profile;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const size_t equals = arg.find('=');
+        const std::string_view flag = arg.substr(0, equals);
+        const std::string_view value = equals == std::string_view::npos ? std::string_view() : arg.substr(equals + 1);
+
+        if (flag == "--lines") profile.lines = parse_value<uint64_t>(flag, value);
+        else if (flag == "--equities") profile.equities = parse_value<uint64_t>(flag, value);
+        else if (flag == "--bonds") profile.bonds = parse_value<uint64_t>(flag, value);
+        else if (flag == "--zipf") profile.zipfExponent = parse_value<double>(flag, value);
+        else if (flag == "--subscribers") profile.subscribers = parse_value<uint64_t>(flag, value);
+        else if (flag == "--free") profile.freeFraction = parse_value<double>(flag, value);
+        else if (flag == "--updates") profile.updateFraction = parse_value<double>(flag, value);
+        else if (flag == "--subscribes") profile.subscribeFraction = parse_value<double>(flag, value);
+        else if (flag == "--seed") profile.seed = parse_value<uint64_t>(flag, value);
+        else throw std::invalid_argument("unknown option '" + std::string(arg) + "'");
+    }
+
+    if (profile.equities > 1000 || profile.bonds > 1000 || profile.equities + profile.bonds == 0) {
+        throw std::invalid_argument("--equities and --bonds must be at most 1000 and not both zero");
+    }
+    if (profile.subscribers == 0) throw std::invalid_argument("--subscribers must be positive");
+    for (double fraction : {profile.freeFraction, profile.updateFraction, profile.subscribeFraction}) {
+        if (!(fraction >= 0.0 && fraction <= 1.0)) {
+            throw std::invalid_argument("--free, --updates and --subscribes must be between 0 and 1");
+        }
+    }
+    return profile;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        LoadGenerator generator(parse_profile(argc, argv));
+        std::string out;
+        generator.write(out);
+        LoadGenerator::flush(out);
+    } catch (const std::exception& e) {
+        std::cerr << "error: " << e.what() << "\n"
+                  << "usage: loadgen [--lines=N] [--equities=N] [--bonds=N] [--zipf=S] [--subscribers=N]\n"
+                  << "               [--free=F] [--updates=F] [--subscribes=F] [--seed=N]\n";
+        return 1;
+    }
+    return 0;
+}
@@ -10,263 +10,3164 @@
  */
 
 #include <iostream>
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <unordered_map>
-#include <unordered_set>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <limits>
 #include <memory>
-#include <iomanip>
-#include <sstream>
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <span>
+#include <condition_variable>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <chrono>
 #include <stdexcept>
+#include <system_error>
+#include <bit>
+#include <charconv>
+#include <cerrno>
+#include <csignal>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#ifdef RAVEN_FIXED_POINT_PRICES
 /**
- * @brief Container for instrument-specific market data
- * 
- * Stores the last traded price and either yield (for bonds) or
- * volume (for equities) along with other relevant market data.
+ * @brief Decimal price with six implied decimals (1.5 is stored as 1500000)
+ *
+ * Parsed from and formatted to text with integer arithmetic only, so prices
+ * never go through a floating-point conversion. Covers magnitudes up to
+ * about 9.2e12.
  */
+struct FixedPrice {
+    static constexpr int64_t kScale = 1'000'000;
+    static constexpr int64_t kMaxWhole = std::numeric_limits<int64_t>::max() / kScale - 1;  // largest whole part
+
+    int64_t micros{0};
+};
+
+using Price = FixedPrice;
 
+inline Price price_from_double(double value) { return {std::llround(value * FixedPrice::kScale)}; }
+/// True when price_from_double() can represent `value`; false for NaN.
+inline bool price_in_range(double value) { return std::fabs(value) < static_cast<double>(FixedPrice::kMaxWhole); }
+inline double price_to_double(Price price) { return static_cast<double>(price.micros) / FixedPrice::kScale; }
+inline uint64_t price_to_volume(Price price) { return static_cast<uint64_t>(price.micros / FixedPrice::kScale); }
+inline Price volume_to_price(uint64_t volume) { return {static_cast<int64_t>(volume) * FixedPrice::kScale}; }
+#else
+using Price = double;
+
+inline Price price_from_double(double value) { return value; }
+inline bool price_in_range(double) { return true; }
+inline double price_to_double(Price price) { return price; }
+inline uint64_t price_to_volume(Price price) { return static_cast<uint64_t>(price); }
+inline Price volume_to_price(uint64_t volume) { return static_cast<double>(volume); }
+#endif
+
+/**
+ * @brief Stored market data of one equity instrument
+ *
+ * `kColumns` lists every field, in the order a columnar store lays them out.
+ */
+struct EquityPayload {
+    Price lastTradedPrice{};
+    uint64_t lastDayVolume{0};
 
-struct InstrumentData {
-    double lastTradedPrice_{0.0};
-    double bondYield_{0.0};
-    uint64_t lastDayVolume_{0};
-    
-    InstrumentData(double price = 0.0, double yield = 0.0, uint64_t volume = 0)
-        : lastTradedPrice_(price), bondYield_(yield), lastDayVolume_(volume) {}
+    static constexpr auto kColumns = std::tuple{&EquityPayload::lastTradedPrice, &EquityPayload::lastDayVolume};
 };
 
 /**
- * @brief Abstract base class for market data publishers
- * 
- * Defines the interface for publishing market data and managing subscriptions.
- * Publishers are responsible for maintaining instrument data and subscriber lists.
+ * @brief Stored market data of one bond instrument
  */
-class Publisher {
+struct BondPayload {
+    Price lastTradedPrice{};
+    Price bondYield{};
+
+    static constexpr auto kColumns = std::tuple{&BondPayload::lastTradedPrice, &BondPayload::bondYield};
+};
+
+/**
+ * @brief Instrument data as reported to subscribers
+ *
+ * Every asset class reports its last traded price and one class-specific
+ * value (volume for equities, yield for bonds), so responses are formatted
+ * the same way whichever publisher produced them.
+ */
+struct Quote {
+    Price lastTradedPrice{};
+    Price value{};
+};
+
+/**
+ * @brief Count, range and total of a set of last traded prices
+ */
+struct PriceSummary {
+    uint64_t count{0};
+    double min{std::numeric_limits<double>::infinity()};
+    double max{-std::numeric_limits<double>::infinity()};
+    double sum{0.0};
+
+    void add(Price price) {
+        const double value = price_to_double(price);
+        ++count;
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+        sum += value;
+    }
+
+    /// Adds `blockCount` contiguous prices, a multiple of four; four independent accumulators let the
+    /// compiler vectorise the loop.
+    void add_block(const Price* prices, size_t blockCount) {
+        double lanesMin[4] = {min, min, min, min};
+        double lanesMax[4] = {max, max, max, max};
+        double lanesSum[4] = {};
+        for (size_t i = 0; i < blockCount; i += 4) {
+            for (size_t lane = 0; lane < 4; ++lane) {
+                const double value = price_to_double(prices[i + lane]);
+                lanesMin[lane] = value < lanesMin[lane] ? value : lanesMin[lane];
+                lanesMax[lane] = value > lanesMax[lane] ? value : lanesMax[lane];
+                lanesSum[lane] += value;
+            }
+        }
+        for (size_t lane = 0; lane < 4; ++lane) {
+            min = lanesMin[lane] < min ? lanesMin[lane] : min;
+            max = lanesMax[lane] > max ? lanesMax[lane] : max;
+            sum += lanesSum[lane];
+        }
+        count += blockCount;
+    }
+};
+
+/**
+ * @brief Compact integer handle identifying a subscriber
+ *
+ * Handles are dense (0, 1, 2, ...) in order of first appearance, so they
+ * can index vectors and bitmaps directly.
+ */
+using SubscriberHandle = uint32_t;
+
+/**
+ * @brief Symbol table interning external subscriber IDs into handles
+ *
+ * Each string ID is hashed exactly once per command; every publisher and
+ * entitlement structure downstream works purely on the returned handle.
+ */
+class SubscriberSymbols {
 public:
-    virtual bool update_data(uint64_t instrumentId, double lastTradedPrice, double extraValue) = 0;
-    virtual bool subscribe(const std::string& subscriberId, uint64_t instrumentId) = 0;
-    virtual bool get_data(const std::string& subscriberId, uint64_t instrumentId, InstrumentData& data) const = 0;
-    virtual ~Publisher() = default;
+    /// Returns the handle for `id`, allocating the next free one on first sight.
+    SubscriberHandle intern(std::string_view id) {
+        auto it = handles_.find(id);
+        if (it != handles_.end()) return it->second;
 
-protected:
-    std::unordered_map<uint64_t, InstrumentData> instrumentData_;
-    std::unordered_map<uint64_t, std::unordered_set<std::string>> subscribers_;
+        if (names_.size() > std::numeric_limits<SubscriberHandle>::max()) {
+            throw std::length_error("subscriber handle space exhausted");
+        }
+        const auto handle = static_cast<SubscriberHandle>(names_.size());
+        names_.emplace_back(id);
+        handles_.emplace(names_.back(), handle);
+        return handle;
+    }
+
+    const std::string& name(SubscriberHandle handle) const { return names_[handle]; }
+    size_t size() const { return names_.size(); }
+
+private:
+    struct TransparentHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view id) const { return std::hash<std::string_view>{}(id); }
+    };
+
+    std::unordered_map<std::string, SubscriberHandle, TransparentHash, std::equal_to<>> handles_;
+    std::deque<std::string> names_;
 };
 
 /**
- * @brief Equity market data publisher
- * 
- * Handles equity instruments (instrumentId < 1000) and their associated
- * market data including last traded price and daily volume.
+ * @brief Adaptive set of subscriber handles (roaring-style bitmap)
+ *
+ * Handles are split by their upper 16 bits into containers. A container
+ * holding few handles is a sorted array of the lower 16 bits; once it grows
+ * past kArrayLimit it converts to a plain 65536-bit bitset, so dense
+ * populations are a single bit test and sparse ones stay compact.
  */
-class EquityPublisher : public Publisher {
+class SubscriberBitmap {
 public:
-    bool update_data(uint64_t instrumentId, double lastTradedPrice, double lastDayVolume) override {
-        if (instrumentId >= 1000) return false;
-        instrumentData_[instrumentId] = InstrumentData(lastTradedPrice, 0.0, static_cast<uint64_t>(lastDayVolume));
+    bool insert(SubscriberHandle handle) {
+        Container& container = container_for(static_cast<uint16_t>(handle >> 16));
+        const auto low = static_cast<uint16_t>(handle & 0xFFFF);
+
+        if (!container.bits.empty()) {
+            uint64_t& word = container.bits[low / 64];
+            const uint64_t mask = uint64_t{1} << (low % 64);
+            if (word & mask) return false;
+            word |= mask;
+            ++container.cardinality;
+            return true;
+        }
+
+        auto it = std::lower_bound(container.array.begin(), container.array.end(), low);
+        if (it != container.array.end() && *it == low) return false;
+        container.array.insert(it, low);
+        ++container.cardinality;
+        if (container.cardinality > kArrayLimit) convert_to_bitset(container);
         return true;
     }
 
-    bool subscribe(const std::string& subscriberId, uint64_t instrumentId) override {
-        if (instrumentId >= 1000) return false;
-        subscribers_[instrumentId].insert(subscriberId);
-        return true;
+    bool contains(SubscriberHandle handle) const {
+        const Container* container = find_container(static_cast<uint16_t>(handle >> 16));
+        if (!container) return false;
+        const auto low = static_cast<uint16_t>(handle & 0xFFFF);
+        if (!container->bits.empty()) {
+            return (container->bits[low / 64] >> (low % 64)) & 1;
+        }
+        return std::binary_search(container->array.begin(), container->array.end(), low);
     }
 
-    bool get_data(const std::string& subscriberId, uint64_t instrumentId, InstrumentData& data) const override {
-        if (instrumentId >= 1000) return false;
-        
-        auto instrumentIt = instrumentData_.find(instrumentId);
-        if (instrumentIt == instrumentData_.end()) return false;
-        
-        auto subscriberIt = subscribers_.find(instrumentId);
-        if (subscriberIt == subscribers_.end() || 
-            subscriberIt->second.find(subscriberId) == subscriberIt->second.end()) {
-            return false;
+    size_t size() const {
+        size_t total = 0;
+        for (const Container& container : containers_) total += container.cardinality;
+        return total;
+    }
+
+    /// Invokes `fn(handle)` for every member in ascending order, a word at a time.
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        for (const Container& container : containers_) {
+            const SubscriberHandle high = SubscriberHandle{container.key} << 16;
+            if (container.bits.empty()) {
+                for (uint16_t low : container.array) fn(high | low);
+                continue;
+            }
+            for (size_t w = 0; w < container.bits.size(); ++w) {
+                for (uint64_t word = container.bits[w]; word; word &= word - 1) {
+                    fn(high | static_cast<SubscriberHandle>(w * 64 + __builtin_ctzll(word)));
+                }
+            }
         }
-        
-        data = instrumentIt->second;
-        return true;
     }
+
+private:
+    static constexpr uint32_t kArrayLimit = 4096;
+
+    struct Container {
+        uint16_t key;
+        uint32_t cardinality{0};
+        std::vector<uint16_t> array;   // sorted low bits while sparse
+        std::vector<uint64_t> bits;    // 1024 words once dense
+    };
+
+    const Container* find_container(uint16_t key) const {
+        auto it = std::lower_bound(containers_.begin(), containers_.end(), key,
+                                   [](const Container& c, uint16_t k) { return c.key < k; });
+        return (it != containers_.end() && it->key == key) ? &*it : nullptr;
+    }
+
+    Container& container_for(uint16_t key) {
+        auto it = std::lower_bound(containers_.begin(), containers_.end(), key,
+                                   [](const Container& c, uint16_t k) { return c.key < k; });
+        if (it == containers_.end() || it->key != key) {
+            it = containers_.insert(it, Container{key, 0, {}, {}});
+        }
+        return *it;
+    }
+
+    static void convert_to_bitset(Container& container) {
+        container.bits.assign(65536 / 64, 0);
+        for (uint16_t low : container.array) {
+            container.bits[low / 64] |= uint64_t{1} << (low % 64);
+        }
+        container.array.clear();
+        container.array.shrink_to_fit();
+    }
+
+    std::vector<Container> containers_;
 };
 
 /**
- * @brief Bond market data publisher
- * 
- * Handles bond instruments (1000 <= instrumentId < 2000) and their associated
- * market data including last traded price and yield.
+ * @brief Contiguous block of instrument IDs owned by one publisher
+ */
+struct InstrumentRange {
+    uint64_t firstId{0};
+    uint64_t count{0};
+
+    constexpr bool contains(uint64_t instrumentId) const { return instrumentId - firstId < count; }
+    constexpr uint64_t end() const { return firstId + count; }
+};
+
+/**
+ * @brief Allocator whose blocks start on a 64-byte cache-line boundary
+ *
+ * Keeps the first element of an instrument array at the start of a line,
+ * so the arrays' cache-line layout does not depend on where the heap
+ * happens to place them.
+ */
+template <typename T>
+struct CacheLineAllocator {
+    using value_type = T;
+    static constexpr std::align_val_t kAlignment{64};
+
+    CacheLineAllocator() = default;
+    template <typename U>
+    CacheLineAllocator(const CacheLineAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), kAlignment)); }
+    void deallocate(T* block, size_t) noexcept { ::operator delete(block, kAlignment); }
+
+    friend bool operator==(const CacheLineAllocator&, const CacheLineAllocator&) { return true; }
+};
+
+template <typename T>
+using CacheLineVector = std::vector<T, CacheLineAllocator<T>>;
+
+/**
+ * @brief Dense, direct-indexed store of one asset class's payloads
+ *
+ * Replaces hashing with a single indexed load: instrument `id` lives in
+ * slot `id - firstId`. A presence bitmap records which slots have received
+ * an update, so lookups of never-published instruments still fail. Slots
+ * hold only the asset class's own Payload, so a 16-byte payload makes a
+ * 24-byte slot; the slot array starts on a cache line.
+ *
+ * Every slot is guarded by a sequence lock so any number of reader threads
+ * can load() concurrently with one writer per instrument. The writer makes
+ * the sequence odd, writes, then makes it even again; a reader retries if it
+ * saw an odd sequence or the sequence moved while it was copying.
  */
-class BondPublisher : public Publisher {
+template <typename Payload>
+class InstrumentTable {
 public:
-    bool update_data(uint64_t instrumentId, double lastTradedPrice, double bondYield) override {
-        if (instrumentId < 1000 || instrumentId >= 2000) return false;
-        instrumentData_[instrumentId] = InstrumentData(lastTradedPrice, bondYield, 0);
-        return true;
+    explicit InstrumentTable(InstrumentRange range)
+        : firstId_(range.firstId), count_(range.count), present_((range.count + 63) / 64), slots_(range.count) {}
+
+    bool in_range(uint64_t instrumentId) const {
+        return instrumentId - firstId_ < count_;
     }
 
-    bool subscribe(const std::string& subscriberId, uint64_t instrumentId) override {
-        if (instrumentId < 1000 || instrumentId >= 2000) return false;
-        subscribers_[instrumentId].insert(subscriberId);
-        return true;
+    /// Writer side; at most one thread may store to a given instrument at a time.
+    void store(uint64_t instrumentId, const Payload& data) {
+        const uint64_t slot = instrumentId - firstId_;
+        Slot& target = slots_[slot];
+        const uint64_t sequence = target.sequence.load(std::memory_order_relaxed);
+        target.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        target.data = data;
+        target.sequence.store(sequence + 2, std::memory_order_release);
+
+        const uint64_t mask = uint64_t{1} << (slot % 64);
+        if (!(present_[slot / 64].load(std::memory_order_relaxed) & mask)) {
+            present_[slot / 64].fetch_or(mask, std::memory_order_release);
+        }
     }
 
-    bool get_data(const std::string& subscriberId, uint64_t instrumentId, InstrumentData& data) const override {
-        if (instrumentId < 1000 || instrumentId >= 2000) return false;
-        
-        auto instrumentIt = instrumentData_.find(instrumentId);
-        if (instrumentIt == instrumentData_.end()) return false;
-        
-        auto subscriberIt = subscribers_.find(instrumentId);
-        if (subscriberIt == subscribers_.end() || 
-            subscriberIt->second.find(subscriberId) == subscriberIt->second.end()) {
-            return false;
+    /// Copies the latest consistent data into `data`; false if the instrument was never updated.
+    bool load(uint64_t instrumentId, Payload& data) const {
+        const uint64_t slot = instrumentId - firstId_;
+        if (slot >= count_) return false;
+        if (!(present_[slot / 64].load(std::memory_order_acquire) & (uint64_t{1} << (slot % 64)))) return false;
+
+        const Slot& source = slots_[slot];
+        for (;;) {
+            const uint64_t before = source.sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            Payload copy = source.data;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (source.sequence.load(std::memory_order_relaxed) == before) {
+                data = copy;
+                return true;
+            }
         }
-        
-        data = instrumentIt->second;
-        return true;
     }
+
+    /// Summarises the last traded price of every present instrument; must not run concurrently with store().
+    PriceSummary summarize_prices() const {
+        PriceSummary summary;
+        for (uint64_t word = 0; word < present_.size(); ++word) {
+            for (uint64_t bits = present_[word].load(std::memory_order_acquire); bits; bits &= bits - 1) {
+                summary.add(slots_[word * 64 + std::countr_zero(bits)].data.lastTradedPrice);
+            }
+        }
+        return summary;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        Payload data;
+    };
+
+    uint64_t firstId_;
+    uint64_t count_;
+    CacheLineVector<std::atomic<uint64_t>> present_;
+    CacheLineVector<Slot> slots_;
 };
 
 /**
- * @brief Abstract base class for market data subscribers
- * 
- * Defines the interface for subscribing to and retrieving market data.
+ * @brief Struct-of-arrays variant of InstrumentTable
+ *
+ * Each field listed in `Payload::kColumns` gets its own contiguous array
+ * (prices, volumes, yields, ...), next to the same presence bitmap and one
+ * sequence lock per instrument; every array starts on a cache line. Point
+ * lookups gather one element from each array; bulk scans such as
+ * summarize_prices() stream through a single array and handle fully
+ * populated 64-instrument blocks without per-element tests.
  */
-class Subscriber {
+template <typename Payload>
+class InstrumentColumns {
 public:
-    virtual bool subscribe(std::shared_ptr<Publisher> publisher, uint64_t instrumentId) = 0;
-    virtual void get_data(std::shared_ptr<Publisher> publisher, uint64_t instrumentId) = 0;
-    virtual ~Subscriber() = default;
-    virtual char get_type() const = 0;
+    explicit InstrumentColumns(InstrumentRange range)
+        : firstId_(range.firstId), count_(range.count), present_((range.count + 63) / 64),
+          sequences_(range.count) {
+        for_each_column([&](auto& column, auto) { column.resize(range.count); });
+    }
 
-protected:
-    std::string subscriberId_;
-    void print_result(bool success, uint64_t instrumentId, const InstrumentData& data) const {
-        if (success) {
-            std::cout << get_type() << "," << subscriberId_ << "," << instrumentId << ","
-                     << std::fixed << std::setprecision(6)
-                     << data.lastTradedPrice_ << ","
-                     << (instrumentId < 1000 ? data.lastDayVolume_ : data.bondYield_)
-                     << std::endl;
+    bool in_range(uint64_t instrumentId) const {
+        return instrumentId - firstId_ < count_;
+    }
+
+    /// Writer side; at most one thread may store to a given instrument at a time.
+    void store(uint64_t instrumentId, const Payload& data) {
+        const uint64_t slot = instrumentId - firstId_;
+        std::atomic<uint64_t>& sequence = sequences_[slot];
+        const uint64_t before = sequence.load(std::memory_order_relaxed);
+        sequence.store(before + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for_each_column([&](auto& column, auto member) { column[slot] = data.*member; });
+        sequence.store(before + 2, std::memory_order_release);
+
+        const uint64_t mask = uint64_t{1} << (slot % 64);
+        if (!(present_[slot / 64].load(std::memory_order_relaxed) & mask)) {
+            present_[slot / 64].fetch_or(mask, std::memory_order_release);
+        }
+    }
+
+    /// Copies the latest consistent data into `data`; false if the instrument was never updated.
+    bool load(uint64_t instrumentId, Payload& data) const {
+        const uint64_t slot = instrumentId - firstId_;
+        if (slot >= count_) return false;
+        if (!(present_[slot / 64].load(std::memory_order_acquire) & (uint64_t{1} << (slot % 64)))) return false;
+
+        const std::atomic<uint64_t>& sequence = sequences_[slot];
+        for (;;) {
+            const uint64_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            Payload copy;
+            for_each_column([&](const auto& column, auto member) { copy.*member = column[slot]; });
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before) {
+                data = copy;
+                return true;
+            }
+        }
+    }
+
+    /// Contiguous array holding field `Member` of every instrument, indexed by `id - firstId`.
+    template <auto Member>
+    const auto* column() const {
+        return std::get<column_index<Member>()>(columns_).data();
+    }
+
+    /// Summarises the last traded price of every present instrument; must not run concurrently with store().
+    PriceSummary summarize_prices() const {
+        const Price* prices = column<&Payload::lastTradedPrice>();
+        PriceSummary summary;
+        for (uint64_t word = 0; word < present_.size(); ++word) {
+            uint64_t bits = present_[word].load(std::memory_order_acquire);
+            if (bits == ~uint64_t{0}) {
+                summary.add_block(prices + word * 64, 64);
+                continue;
+            }
+            for (; bits; bits &= bits - 1) summary.add(prices[word * 64 + std::countr_zero(bits)]);
+        }
+        return summary;
+    }
+
+private:
+    using ColumnList = std::remove_const_t<decltype(Payload::kColumns)>;
+    static constexpr size_t kColumnCount = std::tuple_size_v<ColumnList>;
+
+    template <typename Member>
+    struct FieldOf;
+    template <typename Field>
+    struct FieldOf<Field Payload::*> {
+        using type = Field;
+    };
+
+    template <typename Members>
+    struct Arrays;
+    template <typename... Members>
+    struct Arrays<std::tuple<Members...>> {
+        using type = std::tuple<CacheLineVector<typename FieldOf<Members>::type>...>;
+    };
+
+    template <auto Member, size_t Index = 0>
+    static constexpr size_t column_index() {
+        static_assert(Index < kColumnCount, "Member is not listed in Payload::kColumns");
+        constexpr auto candidate = std::get<Index>(Payload::kColumns);
+        if constexpr (std::is_same_v<decltype(candidate), const decltype(Member)>) {
+            if constexpr (candidate == Member) return Index;
+            else return column_index<Member, Index + 1>();
         } else {
-            std::cout << get_type() << "," << subscriberId_ << "," << instrumentId << ",invalid_request" << std::endl;
+            return column_index<Member, Index + 1>();
         }
     }
+
+    template <typename Fn>
+    void for_each_column(Fn&& fn) {
+        [&]<size_t... Index>(std::index_sequence<Index...>) {
+            (fn(std::get<Index>(columns_), std::get<Index>(Payload::kColumns)), ...);
+        }(std::make_index_sequence<kColumnCount>{});
+    }
+
+    template <typename Fn>
+    void for_each_column(Fn&& fn) const {
+        [&]<size_t... Index>(std::index_sequence<Index...>) {
+            (fn(std::get<Index>(columns_), std::get<Index>(Payload::kColumns)), ...);
+        }(std::make_index_sequence<kColumnCount>{});
+    }
+
+    uint64_t firstId_;
+    uint64_t count_;
+    CacheLineVector<std::atomic<uint64_t>> present_;
+    CacheLineVector<std::atomic<uint64_t>> sequences_;
+    typename Arrays<ColumnList>::type columns_;
 };
 
+#ifdef RAVEN_COLUMNAR_INSTRUMENTS
+template <typename Payload>
+using InstrumentStore = InstrumentColumns<Payload>;
+#else
+template <typename Payload>
+using InstrumentStore = InstrumentTable<Payload>;
+#endif
+
 /**
- * @brief Paid subscriber with unlimited get_data calls
+ * @brief A single instrument update as delivered to push-mode subscribers
  */
-class PaidSubscriber : public Subscriber {
+struct InstrumentUpdate {
+    uint64_t instrumentId{0};
+    Quote quote;
+};
+
+/**
+ * @brief Receiver of updates fanned out by publishers in push mode
+ */
+class UpdateListener {
+public:
+    virtual void on_update(SubscriberHandle subscriber, const InstrumentUpdate& update) = 0;
+    virtual ~UpdateListener() = default;
+};
+
+/**
+ * @brief Outcome of a get_data request; anything but Ok is answered with invalid_request
+ */
+enum class LookupStatus : uint8_t {
+    Ok,
+    BadRange,        // instrument ID outside the publisher's range, or outside every asset class
+    NotSubscribed,
+    NoData,          // subscribed, but the instrument was never updated
+    QuotaExhausted,  // free subscriber out of requests
+    TypeMismatch,    // unknown subscriber type, or not the type the subscriber was first seen with
+};
+
+/**
+ * @brief Answer for one instrument of a get_data_batch
+ */
+struct LookupResult {
+    LookupStatus status{LookupStatus::BadRange};
+    Quote quote;
+};
+
+/**
+ * @brief Abstract base class for market data publishers
+ * 
+ * Defines the interface for publishing market data and managing subscriptions.
+ * Publishers are responsible for maintaining instrument data and subscriber lists.
+ * The built-in asset classes implement it with AssetPublisher, which the
+ * engine calls without virtual dispatch; the virtual interface remains the
+ * adapter for plugin publishers and for callers holding a Publisher pointer.
+ */
+class Publisher {
 public:
-    explicit PaidSubscriber(const std::string& id) {
-        subscriberId_ = id;
+    virtual bool update_data(uint64_t instrumentId, Price lastTradedPrice, Price extraValue) = 0;
+    virtual bool subscribe(SubscriberHandle subscriber, uint64_t instrumentId) = 0;
+    virtual LookupStatus lookup(SubscriberHandle subscriber, uint64_t instrumentId, Quote& quote) const = 0;
+    virtual ~Publisher() = default;
+
+    bool get_data(SubscriberHandle subscriber, uint64_t instrumentId, Quote& quote) const {
+        return lookup(subscriber, instrumentId, quote) == LookupStatus::Ok;
     }
 
-    bool subscribe(std::shared_ptr<Publisher> publisher, uint64_t instrumentId) override {
-        return publisher->subscribe(subscriberId_, instrumentId);
+    /**
+     * Looks up every instrument in `instrumentIds` for `subscriber` with one
+     * call, writing the answer for instrumentIds[i] to results[i]; `results`
+     * must be at least as long. Quotas are left to the caller.
+     */
+    virtual void get_data_batch(SubscriberHandle subscriber, std::span<const uint64_t> instrumentIds,
+                                std::span<LookupResult> results) const {
+        for (size_t i = 0; i < instrumentIds.size(); ++i) {
+            results[i].status = lookup(subscriber, instrumentIds[i], results[i].quote);
+        }
     }
 
-    void get_data(std::shared_ptr<Publisher> publisher, uint64_t instrumentId) override {
-        InstrumentData data;
-        bool success = publisher->get_data(subscriberId_, instrumentId, data);
-        print_result(success, instrumentId, data);
+    const InstrumentRange& range() const { return range_; }
+
+    /// Subscribers entitled to `instrumentId`, or nullptr if it is outside this publisher's range.
+    const SubscriberBitmap* subscribers_of(uint64_t instrumentId) const {
+        if (!range_.contains(instrumentId)) return nullptr;
+        return &subscribers_[instrumentId - range_.firstId];
     }
 
-    char get_type() const override { return 'P'; }
+    /// Enables push mode: each update is forwarded to every subscriber of its instrument.
+    void set_listener(UpdateListener* listener) { listener_ = listener; }
+
+protected:
+    explicit Publisher(InstrumentRange range)
+        : range_(range),
+          subscribers_(range.count) {}
+
+    const InstrumentRange range_;
+    std::vector<SubscriberBitmap> subscribers_;  // indexed by instrumentId - range_.firstId
+    UpdateListener* listener_{nullptr};
+
+    /// In push mode, fans a freshly stored `quote` out to the instrument's subscribers.
+    void publish(uint64_t instrumentId, const Quote& quote) {
+        if (!listener_) return;
+
+        const InstrumentUpdate update{instrumentId, quote};
+        subscribers_[instrumentId - range_.firstId].for_each(
+            [&](SubscriberHandle subscriber) { listener_->on_update(subscriber, update); });
+    }
 };
 
 /**
- * @brief Free subscriber with limited get_data calls (100 requests)
+ * @brief Equity asset class: IDs 0-999, last traded price and daily volume
  */
-class FreeSubscriber : public Subscriber {
-private:
-    int remainingRequests_{100};
+struct EquityClass {
+    using Payload = EquityPayload;
+    static constexpr InstrumentRange kRange{0, 1000};
+
+    static Payload make_payload(Price lastTradedPrice, Price lastDayVolume) {
+        return {lastTradedPrice, price_to_volume(lastDayVolume)};
+    }
+    static Quote quote(const Payload& data) { return {data.lastTradedPrice, volume_to_price(data.lastDayVolume)}; }
+};
+
+/**
+ * @brief Bond asset class: IDs 1000-1999, last traded price and yield
+ */
+struct BondClass {
+    using Payload = BondPayload;
+    static constexpr InstrumentRange kRange{1000, 1000};
+
+    static Payload make_payload(Price lastTradedPrice, Price bondYield) { return {lastTradedPrice, bondYield}; }
+    static Quote quote(const Payload& data) { return {data.lastTradedPrice, data.bondYield}; }
+};
 
+/**
+ * @brief Publisher specialised at compile time for one asset class
+ *
+ * `AssetClass` supplies a constexpr ID range, its Payload type and how an
+ * update becomes a Payload and a Payload a Quote, so range checks fold to a
+ * constant comparison and each class's table stores only its own fields.
+ * The class is final: a caller that knows the concrete type, such as
+ * MarketDataEngine::with_publisher(), gets direct, inlinable calls instead
+ * of virtual ones.
+ */
+template <typename AssetClass>
+class AssetPublisher final : public Publisher {
 public:
-    explicit FreeSubscriber(const std::string& id) {
-        subscriberId_ = id;
+    static constexpr InstrumentRange kRange = AssetClass::kRange;
+
+    AssetPublisher() : Publisher(kRange) {}
+
+    bool update_data(uint64_t instrumentId, Price lastTradedPrice, Price extraValue) override {
+        if (!kRange.contains(instrumentId)) return false;
+        const Payload data = AssetClass::make_payload(lastTradedPrice, extraValue);
+        instrumentData_.store(instrumentId, data);
+        publish(instrumentId, AssetClass::quote(data));
+        return true;
     }
 
-    bool subscribe(std::shared_ptr<Publisher> publisher, uint64_t instrumentId) override {
-        return publisher->subscribe(subscriberId_, instrumentId);
+    bool subscribe(SubscriberHandle subscriber, uint64_t instrumentId) override {
+        if (!kRange.contains(instrumentId)) return false;
+        subscribers_[instrumentId - kRange.firstId].insert(subscriber);
+        return true;
     }
 
-    void get_data(std::shared_ptr<Publisher> publisher, uint64_t instrumentId) override {
-        if (remainingRequests_ <= 0) {
-            print_result(false, instrumentId, InstrumentData());
-            return;
+    LookupStatus lookup(SubscriberHandle subscriber, uint64_t instrumentId, Quote& quote) const override {
+        if (!kRange.contains(instrumentId)) return LookupStatus::BadRange;
+        if (!subscribers_[instrumentId - kRange.firstId].contains(subscriber)) return LookupStatus::NotSubscribed;
+        Payload data;
+        if (!instrumentData_.load(instrumentId, data)) return LookupStatus::NoData;
+        quote = AssetClass::quote(data);
+        return LookupStatus::Ok;
+    }
+
+    void get_data_batch(SubscriberHandle subscriber, std::span<const uint64_t> instrumentIds,
+                        std::span<LookupResult> results) const override {
+        for (size_t i = 0; i < instrumentIds.size(); ++i) {
+            results[i].status = AssetPublisher::lookup(subscriber, instrumentIds[i], results[i].quote);
         }
-        
-        InstrumentData data;
-        bool success = publisher->get_data(subscriberId_, instrumentId, data);
-        if (success) remainingRequests_--;
-        print_result(success, instrumentId, data);
     }
 
-    char get_type() const override { return 'F'; }
+    /// Last-traded-price statistics over every instrument updated so far; not safe during concurrent updates.
+    PriceSummary price_summary() const { return instrumentData_.summarize_prices(); }
+
+private:
+    using Payload = typename AssetClass::Payload;
+
+    InstrumentStore<Payload> instrumentData_{kRange};
 };
 
-int main() {
-    auto equityPublisher = std::make_shared<EquityPublisher>();
-    auto bondPublisher = std::make_shared<BondPublisher>();
-    std::unordered_map<std::string, std::shared_ptr<Subscriber>> subscribers;
+using EquityPublisher = AssetPublisher<EquityClass>;
+using BondPublisher = AssetPublisher<BondClass>;
 
-    int numLines;
-    std::cin >> numLines;
-    std::cin.ignore(); 
+/**
+ * @brief Stand-in publisher for instrument IDs no asset class owns; rejects everything
+ */
+class UnassignedPublisher : public Publisher {
+public:
+    UnassignedPublisher() : Publisher(InstrumentRange{}) {}
 
-    std::string line;
-    for (int i = 0; i < numLines; ++i) {
-        std::getline(std::cin, line);
-        std::istringstream iss(line);
-        std::string command;
-        iss >> command;
+    bool update_data(uint64_t, Price, Price) override { return false; }
+    bool subscribe(SubscriberHandle, uint64_t) override { return false; }
+    LookupStatus lookup(SubscriberHandle, uint64_t, Quote&) const override { return LookupStatus::BadRange; }
+};
 
-        if (command == "P") {
-            uint64_t instrumentId;
-            double lastTradedPrice, extraValue;
-            iss >> instrumentId >> lastTradedPrice >> extraValue;
+/**
+ * @brief Maps instrument ID ranges to the publishers of their asset classes
+ *
+ * Each registered publisher owns the range it was constructed with. Routing
+ * is one indexed load into a per-ID table of class indices, so its cost
+ * does not grow with the number of asset classes. The table starts at the
+ * lowest registered ID, so high ID ranges cost no memory below them. IDs that no class owns
+ * are routed to an UnassignedPublisher. A new asset class (FX, futures,
+ * options, ...) needs only a Publisher subclass and one add() call.
+ */
+class AssetClassRegistry {
+public:
+    static constexpr uint8_t kUnassigned = 0xFF;
 
-            if (instrumentId < 1000) {
-                equityPublisher->update_data(instrumentId, lastTradedPrice, extraValue);
-            } else {
-                bondPublisher->update_data(instrumentId, lastTradedPrice, extraValue);
-            }
-        } else if (command == "S") {
-            std::string type, subscriberId, action;
-            uint64_t instrumentId;
-            iss >> type >> subscriberId >> action >> instrumentId;
-
-            auto publisher = (instrumentId < 1000) ? 
-                std::static_pointer_cast<Publisher>(equityPublisher) : 
-                std::static_pointer_cast<Publisher>(bondPublisher);
-
-            bool validSubscriber = true;
-            auto existingSubscriber = subscribers.find(subscriberId);
-            if (existingSubscriber != subscribers.end()) {
-                char existingType = existingSubscriber->second->get_type();
-                if (existingType != type[0]) {
-                    validSubscriber = false;  
-                }
-            } else if (type == "P") {
-                subscribers[subscriberId] = std::make_shared<PaidSubscriber>(subscriberId);
-            } else if (type == "F") {
-                subscribers[subscriberId] = std::make_shared<FreeSubscriber>(subscriberId);
+    /// Registers `publisher` under `name` for its range; returns the class index.
+    uint8_t add(std::string name, std::shared_ptr<Publisher> publisher) {
+        const InstrumentRange range = publisher->range();
+        if (classes_.size() >= kUnassigned) throw std::invalid_argument("too many asset classes");
+        for (uint64_t id = range.firstId; id < range.end(); ++id) {
+            const uint8_t owner = class_of(id);
+            if (owner != kUnassigned) {
+                throw std::invalid_argument("asset class '" + name + "' overlaps '" + classes_[owner].name + "'");
             }
+        }
 
-            if (action == "get_data") {
-                if (validSubscriber && subscribers.count(subscriberId)) {
-                    subscribers[subscriberId]->get_data(publisher, instrumentId);
-                } else {
-                    std::cout << type << "," << subscriberId << "," << instrumentId 
-                             << ",invalid_request" << std::endl;
-                }
-            } else if (action == "subscribe" && validSubscriber && subscribers.count(subscriberId)) {
-                subscribers[subscriberId]->subscribe(publisher, instrumentId);
+        if (classOf_.empty()) {
+            firstId_ = range.firstId;
+        } else if (range.firstId < firstId_) {
+            classOf_.insert(classOf_.begin(), firstId_ - range.firstId, kUnassigned);
+            firstId_ = range.firstId;
+        }
+        if (range.end() - firstId_ > classOf_.size()) classOf_.resize(range.end() - firstId_, kUnassigned);
+
+        const auto index = static_cast<uint8_t>(classes_.size());
+        std::fill(classOf_.begin() + (range.firstId - firstId_), classOf_.begin() + (range.end() - firstId_), index);
+        classes_.push_back({std::move(name), std::move(publisher)});
+        return index;
+    }
+
+    /// Index of the asset class owning `instrumentId`, or kUnassigned.
+    uint8_t class_of(uint64_t instrumentId) const {
+        const uint64_t offset = instrumentId - firstId_;  // wraps for IDs below firstId_
+        return offset < classOf_.size() ? classOf_[offset] : kUnassigned;
+    }
+
+    const std::shared_ptr<Publisher>& publisher_for(uint64_t instrumentId) const {
+        const uint8_t index = class_of(instrumentId);
+        return index == kUnassigned ? unassigned_ : classes_[index].publisher;
+    }
+
+    size_t size() const { return classes_.size(); }
+    const std::string& name(size_t index) const { return classes_[index].name; }
+    const std::shared_ptr<Publisher>& publisher(size_t index) const { return classes_[index].publisher; }
+
+private:
+    struct AssetClass {
+        std::string name;
+        std::shared_ptr<Publisher> publisher;
+    };
+
+    std::vector<AssetClass> classes_;
+    std::vector<uint8_t> classOf_;  // class index per instrument ID, starting at firstId_
+    uint64_t firstId_{0};
+    std::shared_ptr<Publisher> unassigned_ = std::make_shared<UnassignedPublisher>();
+};
+
+/// Writes `value` to `out` in little-endian byte order.
+template <typename T>
+void store_le(char* out, T value) {
+    if constexpr (std::endian::native == std::endian::big) {
+        if constexpr (sizeof(T) == 2) value = __builtin_bswap16(value);
+        if constexpr (sizeof(T) == 4) value = __builtin_bswap32(value);
+        if constexpr (sizeof(T) == 8) value = __builtin_bswap64(value);
+    }
+    std::memcpy(out, &value, sizeof(value));
+}
+
+/// Reads a little-endian `T` from `in`, which need not be aligned.
+template <typename T>
+T load_le(const char* in) {
+    T value;
+    std::memcpy(&value, in, sizeof(value));
+    if constexpr (std::endian::native == std::endian::big) {
+        if constexpr (sizeof(T) == 2) value = __builtin_bswap16(value);
+        if constexpr (sizeof(T) == 4) value = __builtin_bswap32(value);
+        if constexpr (sizeof(T) == 8) value = __builtin_bswap64(value);
+    }
+    return value;
+}
+
+/**
+ * @brief Buffered writer for response lines
+ *
+ * Lines accumulate in a reusable buffer that is written out with a single
+ * write(2) when it fills, when maybe_flush() finds the flush interval has
+ * elapsed, or when flush() is called explicitly, e.g. whenever the input
+ * runs dry (see CommandInput::set_idle_handler).
+ * Numbers are formatted with std::to_chars, which for doubles produces the
+ * same text as std::fixed with std::setprecision(6).
+ *
+ * A sink constructed with kMemory never writes; its buffer grows instead and
+ * the formatted text is read back with contents().
+ */
+class OutputSink {
+public:
+    static constexpr int kMemory = -1;
+
+    explicit OutputSink(int fd = STDOUT_FILENO, size_t capacity = size_t{1} << 16,
+                        std::chrono::milliseconds flushInterval = std::chrono::milliseconds(100))
+        : fd_(fd), buffer_(capacity), flushInterval_(flushInterval),
+          lastFlush_(std::chrono::steady_clock::now()) {}
+
+    ~OutputSink() {
+        try {
+            flush();
+        } catch (const std::exception&) {
+        }
+    }
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    void append(char c) {
+        reserve(1);
+        buffer_[size_++] = c;
+    }
+
+    void append(std::string_view text) {
+        if (text.size() > buffer_.size() - size_) {
+            reserve(text.size());
+            if (text.size() > buffer_.size() - size_) {
+                write_all(text.data(), text.size());
+                return;
             }
         }
+        std::memcpy(buffer_.data() + size_, text.data(), text.size());
+        size_ += text.size();
+    }
+
+    void append_uint(uint64_t value) {
+        reserve(kMaxNumberLength);
+        size_ = std::to_chars(buffer_.data() + size_, buffer_.data() + buffer_.size(), value).ptr - buffer_.data();
+    }
+
+    /// Appends `value` with exactly six decimals, e.g. 1501449788.000000.
+    void append_fixed6(double value) {
+        reserve(kMaxNumberLength);
+        auto result = std::to_chars(buffer_.data() + size_, buffer_.data() + buffer_.size(),
+                                    value, std::chars_format::fixed, 6);
+        if (result.ec != std::errc()) {
+            // Magnitudes beyond ~1e300 need more room than a number normally takes.
+            char wide[512];
+            result = std::to_chars(wide, wide + sizeof(wide), value, std::chars_format::fixed, 6);
+            append(std::string_view(wide, result.ptr - wide));
+            return;
+        }
+        size_ = result.ptr - buffer_.data();
+    }
+
+#ifdef RAVEN_FIXED_POINT_PRICES
+    /// Appends `price` with exactly six decimals using integer arithmetic only.
+    void append_fixed6(FixedPrice price) {
+        reserve(kMaxNumberLength);
+        const bool negative = price.micros < 0;
+        const uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(price.micros) : price.micros;
+        if (negative) buffer_[size_++] = '-';
+        append_uint(magnitude / FixedPrice::kScale);
+        buffer_[size_++] = '.';
+        uint64_t fraction = magnitude % FixedPrice::kScale;
+        for (int digit = 5; digit >= 0; --digit, fraction /= 10) {
+            buffer_[size_ + digit] = static_cast<char>('0' + fraction % 10);
+        }
+        size_ += 6;
+    }
+#endif
+
+    /// Marks the end of a response line.
+    void end_record() { append('\n'); }
+
+    /**
+     * Called once per input command; flushes if the flush interval has
+     * elapsed. The clock is only read every few commands, which is enough
+     * while input keeps arriving; when it stops, the idle flush takes over.
+     */
+    void maybe_flush() {
+        if (fd_ == kMemory || ++commandsSinceCheck_ < kCommandsPerClockCheck) return;
+        commandsSinceCheck_ = 0;
+        if (std::chrono::steady_clock::now() - lastFlush_ >= flushInterval_) flush();
+    }
+
+    /// Whether responses written to this sink use the WireResponse encoding instead of text.
+    bool binary_responses() const { return binaryResponses_; }
+    void set_binary_responses(bool binary) { binaryResponses_ = binary; }
+
+    void flush() {
+        if (fd_ == kMemory) return;
+        if (size_ > 0) write_all(buffer_.data(), size_);
+        size_ = 0;
+        lastFlush_ = std::chrono::steady_clock::now();
+    }
+
+    /// Text appended since the last clear(); meaningful for kMemory sinks.
+    std::string_view contents() const { return std::string_view(buffer_.data(), size_); }
+    void clear() { size_ = 0; }
+
+private:
+    static constexpr size_t kMaxNumberLength = 64;
+    static constexpr uint32_t kCommandsPerClockCheck = 256;
+
+    void reserve(size_t bytes) {
+        if (buffer_.size() - size_ >= bytes) return;
+        if (fd_ == kMemory) {
+            buffer_.resize(std::max(buffer_.size() * 2, size_ + bytes));
+        } else {
+            flush();
+        }
+    }
+
+    void write_all(const char* data, size_t length) {
+        while (length > 0) {
+            ssize_t written = ::write(fd_, data, length);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "write");
+            }
+            data += written;
+            length -= static_cast<size_t>(written);
+        }
+    }
+
+    int fd_;
+    std::vector<char> buffer_;
+    size_t size_{0};
+    uint32_t commandsSinceCheck_{0};
+    bool binaryResponses_{false};
+    std::chrono::milliseconds flushInterval_;
+    std::chrono::steady_clock::time_point lastFlush_;
+};
+
+/**
+ * @brief Fixed-size binary response record, the alternative to a CSV line
+ *
+ * Written little-endian in exactly this struct's layout, so consumers on
+ * little-endian hosts can read a response by casting a pointer into the
+ * stream. `value` is the volume for equities and the yield for bonds; price
+ * and value are zero for an invalid request. Subscriber handles are assigned
+ * 0, 1, 2, ... in order of each subscriber ID's first appearance in the input.
+ */
+struct WireResponse {
+    static constexpr uint8_t kStatusOk = 0;
+    static constexpr uint8_t kStatusInvalidRequest = 1;
+
+    uint32_t subscriber;      // SubscriberHandle
+    uint8_t status;
+    char subscriberType;      // 'P' or 'F' (first byte of the requested type for unknown subscribers)
+    uint16_t reserved;
+    uint64_t instrumentId;
+    double lastTradedPrice;
+    double value;
+
+    void write_to(OutputSink& out) const {
+        char record[sizeof(WireResponse)];
+        store_le(record + offsetof(WireResponse, subscriber), subscriber);
+        record[offsetof(WireResponse, status)] = static_cast<char>(status);
+        record[offsetof(WireResponse, subscriberType)] = subscriberType;
+        store_le(record + offsetof(WireResponse, reserved), reserved);
+        store_le(record + offsetof(WireResponse, instrumentId), instrumentId);
+        store_le(record + offsetof(WireResponse, lastTradedPrice), std::bit_cast<uint64_t>(lastTradedPrice));
+        store_le(record + offsetof(WireResponse, value), std::bit_cast<uint64_t>(value));
+        out.append(std::string_view(record, sizeof(record)));
+    }
+};
+
+static_assert(sizeof(WireResponse) == 32, "WireResponse layout is part of the wire format");
+
+/**
+ * @brief Bounded lock-free single-producer/single-consumer ring buffer
+ *
+ * Capacity is rounded up to a power of two so slot indexing is a mask.
+ * Head and tail live on separate cache lines, each next to the other
+ * side's cached copy of its counterpart, so in steady state a push or pop
+ * touches only lines owned by its own thread.
+ */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : mask_(round_up_pow2(capacity) - 1), slots_(mask_ + 1) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /// Producer side; returns false without blocking when the ring is full.
+    bool try_push(const T& item) {
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ > mask_) {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - cachedHead_ > mask_) return false;
+        }
+        slots_[tail & mask_] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side; moves up to `max` items into `out` and returns how many.
+    size_t pop_batch(T* out, size_t max) {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        if (cachedTail_ == head) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (cachedTail_ == head) return 0;
+        }
+        const size_t count = std::min<uint64_t>(cachedTail_ - head, max);
+        for (size_t i = 0; i < count; ++i) out[i] = slots_[(head + i) & mask_];
+        head_.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    static size_t round_up_pow2(size_t value) {
+        size_t result = 1;
+        while (result < value) result <<= 1;
+        return result;
+    }
+
+    alignas(64) std::atomic<uint64_t> head_{0};
+    uint64_t cachedTail_{0};   // consumer's view of tail_
+    alignas(64) std::atomic<uint64_t> tail_{0};
+    uint64_t cachedHead_{0};   // producer's view of head_
+    alignas(64) const size_t mask_;
+    std::vector<T> slots_;
+};
+
+/**
+ * @brief Per-subscriber delivery path with conflation for slow consumers
+ *
+ * Updates normally flow through a lock-free SpscRing. Once the ring is full
+ * the subscriber has fallen behind, and further updates are conflated: only
+ * the latest update per instrument is kept, in a dirty set the consumer
+ * takes after emptying the ring. The producer keeps conflating until that
+ * set has been taken, so a newer ring entry can never be overtaken by an
+ * older conflated one. Memory stays bounded by ring size plus one entry per
+ * instrument, and the producer never waits on the consumer beyond the O(1)
+ * swap in drain().
+ */
+class DeliveryQueue {
+public:
+    explicit DeliveryQueue(size_t ringCapacity) : ring_(ringCapacity) {}
+
+    /// Producer side; true if `update` overwrote an undelivered update for the same instrument.
+    bool push(const InstrumentUpdate& update) {
+        if (!conflating_.load(std::memory_order_acquire) && ring_.try_push(update)) return false;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto [it, inserted] = dirtyIndex_.try_emplace(update.instrumentId, dirty_.size());
+        if (inserted) {
+            dirty_.push_back(update);
+        } else {
+            dirty_[it->second] = update;
+        }
+        conflating_.store(true, std::memory_order_release);
+        return !inserted;
+    }
+
+    /// Consumer side: invokes `fn(update)` for queued updates, ring first, then the dirty set.
+    template <typename Fn>
+    void drain(Fn&& fn) {
+        InstrumentUpdate batch[kDrainBatch];
+        while (size_t count = ring_.pop_batch(batch, kDrainBatch)) {
+            for (size_t i = 0; i < count; ++i) fn(batch[i]);
+        }
+        if (!conflating_.load(std::memory_order_acquire)) return;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            taken_.swap(dirty_);
+            dirtyIndex_.clear();
+            conflating_.store(false, std::memory_order_release);
+        }
+        for (const InstrumentUpdate& update : taken_) fn(update);
+        taken_.clear();
+    }
+
+    bool empty() const { return ring_.empty() && !conflating_.load(std::memory_order_acquire); }
+
+private:
+    static constexpr size_t kDrainBatch = 64;
+
+    SpscRing<InstrumentUpdate> ring_;
+    std::atomic<bool> conflating_{false};
+    std::mutex mutex_;
+    std::vector<InstrumentUpdate> dirty_;                  // latest per instrument, first-dirtied order
+    std::unordered_map<uint64_t, size_t> dirtyIndex_;      // instrumentId -> position in dirty_
+    std::vector<InstrumentUpdate> taken_;                  // consumer-owned scratch
+};
+
+/**
+ * @brief Abstract base class for market data subscribers
+ * 
+ * Defines the interface for subscribing to and retrieving market data.
+ */
+class Subscriber {
+public:
+    virtual bool subscribe(std::shared_ptr<Publisher> publisher, uint64_t instrumentId) = 0;
+    virtual LookupStatus get_data(std::shared_ptr<Publisher> publisher, uint64_t instrumentId, OutputSink& out) = 0;
+    virtual ~Subscriber() = default;
+    virtual char get_type() const = 0;
+    SubscriberHandle handle() const { return handle_; }
+
+    /// Gives the subscriber a delivery queue so publishers can push updates to it.
+    void enable_push(size_t queueCapacity) {
+        queue_ = std::make_unique<DeliveryQueue>(queueCapacity);
+    }
+
+    /// Producer side: queues an update pushed by a publisher until the next drain(); true if it was conflated.
+    bool enqueue(const InstrumentUpdate& update) {
+        return queue_ && queue_->push(update);
+    }
+
+    /**
+     * Charges one request against the subscriber's quota; false once the quota
+     * is exhausted. Called for every successful lookup and pushed update.
+     */
+    virtual bool consume_request() { return true; }
+
+    /// Whether the subscriber has used up its request quota; never for unlimited tiers.
+    virtual bool quota_exhausted() const { return false; }
+
+    /// Formats one response line; safe to call from any thread.
+    void print_result(OutputSink& out, bool success, uint64_t instrumentId, const Quote& quote) const {
+        if (out.binary_responses()) {
+            WireResponse response{};
+            response.subscriber = handle_;
+            response.subscriberType = get_type();
+            response.instrumentId = instrumentId;
+            if (success) {
+                response.status = WireResponse::kStatusOk;
+                response.lastTradedPrice = price_to_double(quote.lastTradedPrice);
+                response.value = price_to_double(quote.value);
+            } else {
+                response.status = WireResponse::kStatusInvalidRequest;
+            }
+            response.write_to(out);
+            return;
+        }
+
+        out.append(get_type());
+        out.append(',');
+        out.append(subscriberId_);
+        out.append(',');
+        out.append_uint(instrumentId);
+        if (success) {
+            out.append(',');
+            out.append_fixed6(quote.lastTradedPrice);
+            out.append(',');
+            out.append_fixed6(quote.value);
+        } else {
+            out.append(",invalid_request");
+        }
+        out.end_record();
+    }
+
+    bool has_pending() const { return queue_ && !queue_->empty(); }
+
+    /**
+     * Consumer side: prints every queued update that the subscriber is entitled
+     * to receive. Returns how many were dropped because the quota ran out.
+     */
+    uint64_t drain(OutputSink& out) {
+        uint64_t dropped = 0;
+        if (!queue_) return dropped;
+        queue_->drain([&](const InstrumentUpdate& update) {
+            if (consume_request()) {
+                print_result(out, true, update.instrumentId, update.quote);
+            } else {
+                ++dropped;
+            }
+        });
+        return dropped;
+    }
+
+protected:
+    Subscriber(SubscriberHandle handle, std::string_view id) : handle_(handle), subscriberId_(id) {}
+
+    SubscriberHandle handle_;
+    std::string subscriberId_;
+    std::unique_ptr<DeliveryQueue> queue_;  // set only in push mode
+};
+
+/**
+ * @brief Paid subscriber with unlimited get_data calls
+ */
+class PaidSubscriber : public Subscriber {
+public:
+    PaidSubscriber(SubscriberHandle handle, std::string_view id) : Subscriber(handle, id) {}
+
+    bool subscribe(std::shared_ptr<Publisher> publisher, uint64_t instrumentId) override {
+        return publisher->subscribe(handle_, instrumentId);
+    }
+
+    LookupStatus get_data(std::shared_ptr<Publisher> publisher, uint64_t instrumentId, OutputSink& out) override {
+        Quote quote;
+        const LookupStatus status = publisher->lookup(handle_, instrumentId, quote);
+        print_result(out, status == LookupStatus::Ok, instrumentId, quote);
+        return status;
+    }
+
+    char get_type() const override { return 'P'; }
+};
+
+/**
+ * @brief Free subscriber with limited get_data calls (100 requests)
+ */
+class FreeSubscriber : public Subscriber {
+private:
+    int remainingRequests_{100};
+
+public:
+    FreeSubscriber(SubscriberHandle handle, std::string_view id) : Subscriber(handle, id) {}
+
+    bool subscribe(std::shared_ptr<Publisher> publisher, uint64_t instrumentId) override {
+        return publisher->subscribe(handle_, instrumentId);
+    }
+
+    LookupStatus get_data(std::shared_ptr<Publisher> publisher, uint64_t instrumentId, OutputSink& out) override {
+        if (remainingRequests_ <= 0) {
+            print_result(out, false, instrumentId, Quote());
+            return LookupStatus::QuotaExhausted;
+        }
+        
+        Quote quote;
+        const LookupStatus status = publisher->lookup(handle_, instrumentId, quote);
+        if (status == LookupStatus::Ok) remainingRequests_--;
+        print_result(out, status == LookupStatus::Ok, instrumentId, quote);
+        return status;
+    }
+
+    char get_type() const override { return 'F'; }
+
+    bool quota_exhausted() const override { return remainingRequests_ <= 0; }
+
+    bool consume_request() override {
+        if (remainingRequests_ <= 0) return false;
+        remainingRequests_--;
+        return true;
+    }
+};
+
+/**
+ * @brief Handle-indexed table of subscriber objects
+ *
+ * Also acts as the push-mode listener: pushed updates are queued on the
+ * target subscriber, and subscribers with something queued are remembered
+ * so drain() only visits those.
+ */
+class SubscriberDirectory : public UpdateListener {
+public:
+    /// The (possibly empty) subscriber slot for `handle`.
+    std::shared_ptr<Subscriber>& slot(SubscriberHandle handle) {
+        if (handle >= subscribers_.size()) subscribers_.resize(handle + 1);
+        return subscribers_[handle];
+    }
+
+    /// Push-mode delivery outcomes, accumulated until take_push_stats().
+    struct PushStats {
+        uint64_t conflated{0};        // updates overwritten by a newer one before delivery
+        uint64_t dropped{0};          // updates not delivered because the subscriber's quota ran out
+        uint64_t quotasExhausted{0};  // free subscribers whose last request went to a push
+    };
+
+    void on_update(SubscriberHandle subscriber, const InstrumentUpdate& update) override {
+        Subscriber& target = *subscribers_[subscriber];
+        if (!target.has_pending()) ready_.push_back(subscriber);
+        if (target.enqueue(update)) ++stats_.conflated;
+    }
+
+    /// Delivery outcomes since the last call.
+    PushStats take_push_stats() { return std::exchange(stats_, PushStats{}); }
+
+    /// Delivers all queued updates, subscriber by subscriber in the order they became ready.
+    void drain(OutputSink& out) {
+        for (SubscriberHandle handle : ready_) {
+            Subscriber& subscriber = *subscribers_[handle];
+            const bool hadQuota = !subscriber.quota_exhausted();
+            stats_.dropped += subscriber.drain(out);
+            if (hadQuota && subscriber.quota_exhausted()) ++stats_.quotasExhausted;
+        }
+        ready_.clear();
+    }
+
+private:
+    std::vector<std::shared_ptr<Subscriber>> subscribers_;  // indexed by SubscriberHandle
+    std::vector<SubscriberHandle> ready_;
+    PushStats stats_;
+};
+
+/**
+ * @brief Fixed-size little-endian binary form of a `P` update
+ *
+ * Feed handlers may send these 32-byte records in place of text `P` lines,
+ * freely mixed with text lines; each record counts as one line toward the
+ * line count in the header. A record is recognised by its first byte,
+ * kMarker, which cannot begin a text command.
+ *
+ *   offset  size  field
+ *        0     1  marker (0xB1)
+ *        1     1  message type (1 = update)
+ *        2     2  reserved, zero
+ *        4     4  sequence number
+ *        8     8  instrument id
+ *       16     8  last traded price (IEEE 754 double)
+ *       24     8  volume or yield (IEEE 754 double)
+ */
+struct WireUpdate {
+    static constexpr unsigned char kMarker = 0xB1;
+    static constexpr uint8_t kTypeUpdate = 1;
+    static constexpr size_t kSize = 32;
+
+    uint8_t messageType{kTypeUpdate};
+    uint32_t sequence{0};
+    uint64_t instrumentId{0};
+    double lastTradedPrice{0.0};
+    double extraValue{0.0};
+
+    static bool is_record(std::string_view bytes) {
+        return bytes.size() == kSize && static_cast<unsigned char>(bytes.front()) == kMarker;
+    }
+
+    void encode(char* out) const {
+        out[0] = static_cast<char>(kMarker);
+        out[1] = static_cast<char>(messageType);
+        out[2] = out[3] = 0;
+        store_le(out + 4, sequence);
+        store_le(out + 8, instrumentId);
+        store_le(out + 16, std::bit_cast<uint64_t>(lastTradedPrice));
+        store_le(out + 24, std::bit_cast<uint64_t>(extraValue));
+    }
+
+    static WireUpdate decode(const char* in) {
+        WireUpdate update;
+        update.messageType = static_cast<uint8_t>(in[1]);
+        update.sequence = load_le<uint32_t>(in + 4);
+        update.instrumentId = load_le<uint64_t>(in + 8);
+        update.lastTradedPrice = std::bit_cast<double>(load_le<uint64_t>(in + 16));
+        update.extraValue = std::bit_cast<double>(load_le<uint64_t>(in + 24));
+        return update;
+    }
+
+};
+
+/**
+ * @brief Field offsets of one text command line, as found by FieldScanner
+ */
+struct LineFields {
+    static constexpr size_t kMaxFields = 8;  // further fields are ignored
+
+    size_t count{0};
+    size_t begin[kMaxFields];
+    size_t end[kMaxFields];
+
+    /// Field `index` of `line`, or an empty view if the line has fewer fields.
+    std::string_view get(std::string_view line, size_t index) const {
+        return index < count ? line.substr(begin[index], end[index] - begin[index]) : std::string_view();
+    }
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RAVEN_X86_SIMD 1
+
+/**
+ * @brief Byte classifiers turning 64 input bytes into whitespace and newline bitmasks
+ *
+ * Whitespace is the set operator>> skips: space and '\t' through '\r'.
+ */
+struct Sse42Classifier {
+    [[gnu::target("sse4.2")]] static void classify(const char* block, uint64_t& whitespace, uint64_t& newlines) {
+        // PCMPESTRM range mode: bytes in ['\t', '\r'] or [' ', ' '].
+        const __m128i ranges = _mm_setr_epi8('\t', '\r', ' ', ' ', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i newline = _mm_set1_epi8('\n');
+        whitespace = newlines = 0;
+        for (unsigned i = 0; i < 4; ++i) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+            const __m128i spaces = _mm_cmpestrm(ranges, 4, bytes, 16,
+                                                _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK);
+            whitespace |= uint64_t{static_cast<uint16_t>(_mm_cvtsi128_si32(spaces))} << (16 * i);
+            newlines |= uint64_t{static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)))}
+                        << (16 * i);
+        }
+    }
+};
+
+struct Avx2Classifier {
+    [[gnu::target("avx2")]] static void classify(const char* block, uint64_t& whitespace, uint64_t& newlines) {
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i tab = _mm256_set1_epi8('\t');
+        const __m256i controlSpan = _mm256_set1_epi8('\r' - '\t');
+        const __m256i newline = _mm256_set1_epi8('\n');
+        whitespace = newlines = 0;
+        for (unsigned i = 0; i < 2; ++i) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+            // c - '\t' <= '\r' - '\t' as unsigned bytes  <=>  '\t' <= c <= '\r'
+            const __m256i offset = _mm256_sub_epi8(bytes, tab);
+            const __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, controlSpan), offset);
+            const __m256i spaces = _mm256_or_si256(control, _mm256_cmpeq_epi8(bytes, space));
+            whitespace |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(spaces))} << (32 * i);
+            newlines |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline)))}
+                        << (32 * i);
+        }
+    }
+};
+#endif
+
+/**
+ * @brief Finds line ends and field offsets in a region of input
+ *
+ * With SSE4.2 or AVX2 (the fastest the CPU supports, chosen at startup),
+ * each 64-byte block of the region is classified once into whitespace and
+ * newline bitmasks, and every line starting in that block takes its newline
+ * and field edges from the cached masks with a few bit scans. A block that
+ * would run past the end of the region is copied into a space-padded buffer
+ * first, so nothing outside the region is ever read. The scalar fallback
+ * finds the line end with memchr and splits fields with a byte loop, which
+ * beats classifying whole blocks one byte at a time.
+ *
+ * Lines must be scanned in order within a region; call reset() whenever the
+ * region changes, since a new chunk may reuse the previous one's memory.
+ */
+class FieldScanner {
+public:
+    /// Forgets the cached block.
+    void reset() { blockStart_ = nullptr; }
+
+    /// Scans the line starting at `line` up to the first '\n'; returns its offset, or `end - line` if there is none.
+    size_t scan(const char* line, const char* end, LineFields& fields) {
+        if (line == end) {  // also covers the null region before an input's first chunk
+            fields.count = 0;
+            return 0;
+        }
+        if (!classify_) return scan_scalar(line, static_cast<size_t>(end - line), fields);
+
+        fields.count = 0;
+        if (!blockStart_ || line < blockStart_ || line >= blockStart_ + 64) load(line, end);
+        const char* block = blockStart_;
+        size_t skip = line - block;  // bytes of the block before the line starts
+        bool inField = false;        // whether the byte before the current block belongs to a field
+
+        for (;;) {
+            const uint64_t fromLine = ~uint64_t{0} << skip;
+            const uint64_t newlines = newlines_ & fromLine;
+            const size_t limit = newlines ? std::countr_zero(newlines) : 64;
+            const uint64_t inLine = (limit == 64 ? ~uint64_t{0} : (uint64_t{1} << limit) - 1) & fromLine;
+            const uint64_t field = ~whitespace_ & inLine;
+
+            const size_t base = block - line;
+            for (uint64_t edges = field ^ ((field << 1) | uint64_t{inField}); edges; edges &= edges - 1) {
+                const size_t position = base + std::countr_zero(edges);
+                if (!inField) {
+                    if (fields.count < LineFields::kMaxFields) fields.begin[fields.count] = position;
+                } else if (fields.count < LineFields::kMaxFields) {
+                    fields.end[fields.count++] = position;
+                }
+                inField = !inField;
+            }
+            if (newlines) return base + limit;
+            if (end - block <= 64) break;
+            load(block + 64, end);
+            block = blockStart_;
+            skip = 0;
+        }
+
+        if (inField && fields.count < LineFields::kMaxFields) fields.end[fields.count++] = end - line;
+        return end - line;
+    }
+
+    static const char* name() { return name_; }
+
+    /// Forces an implementation: "scalar", "sse4.2" or "avx2". False if this CPU lacks it.
+    static bool select(std::string_view name) {
+        if (name == "scalar") return use(nullptr, "scalar");
+#ifdef RAVEN_X86_SIMD
+        __builtin_cpu_init();
+        if (name == "sse4.2" && __builtin_cpu_supports("sse4.2")) return use(&Sse42Classifier::classify, "sse4.2");
+        if (name == "avx2" && __builtin_cpu_supports("avx2")) return use(&Avx2Classifier::classify, "avx2");
+#endif
+        return false;
+    }
+
+private:
+    using ClassifyFn = void (*)(const char* block, uint64_t& whitespace, uint64_t& newlines);
+
+    /// Classifies the 64 bytes at `block`, padding with spaces past `end`.
+    void load(const char* block, const char* end) {
+        blockStart_ = block;
+        const size_t valid = std::min<size_t>(64, end - block);
+        if (valid == 64) {
+            classify_(block, whitespace_, newlines_);
+            return;
+        }
+        char padded[64];
+        std::memcpy(padded, block, valid);
+        std::memset(padded + valid, ' ', 64 - valid);
+        classify_(padded, whitespace_, newlines_);
+    }
+
+    static size_t scan_scalar(const char* line, size_t size, LineFields& fields) {
+        const auto* newline = static_cast<const char*>(std::memchr(line, '\n', size));
+        const size_t length = newline ? static_cast<size_t>(newline - line) : size;
+
+        size_t count = 0;
+        const char* cursor = line;
+        const char* const end = line + length;
+        while (count < LineFields::kMaxFields) {
+            while (cursor != end && is_space(*cursor)) ++cursor;
+            if (cursor == end) break;
+            fields.begin[count] = cursor - line;
+            while (cursor != end && !is_space(*cursor)) ++cursor;
+            fields.end[count++] = cursor - line;
+        }
+        fields.count = count;
+        return length;
+    }
+
+    static bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+    static bool use(ClassifyFn classify, const char* name) {
+        classify_ = classify;
+        name_ = name;
+        return true;
+    }
+
+    static ClassifyFn detect() {
+        if (select("avx2") || select("sse4.2")) return classify_;
+        return nullptr;
+    }
+
+    inline static const char* name_ = "scalar";
+    inline static ClassifyFn classify_ = detect();
+
+    const char* blockStart_{nullptr};  // start of the cached block; null when there is none
+    uint64_t whitespace_{0};
+    uint64_t newlines_{0};
+};
+
+/**
+ * @brief Background thread reading a pipe into a small ring of buffers
+ *
+ * The reader thread keeps up to kBufferCount chunks filled ahead of the
+ * consumer, so parsing one chunk overlaps with waiting on the next read.
+ * The consumer holds at most one chunk at a time; asking for the next one
+ * hands the previous one back to the reader.
+ */
+class AsyncBlockReader {
+public:
+    AsyncBlockReader(int fd, size_t blockSize) : fd_(fd) {
+        if (::pipe(wakePipe_) != 0) throw std::system_error(errno, std::generic_category(), "pipe");
+        for (Buffer& buffer : buffers_) buffer.data.resize(blockSize);
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~AsyncBlockReader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_all();
+        const char wake = 0;
+        (void)!::write(wakePipe_[1], &wake, 1);  // interrupts a reader blocked in poll()
+        thread_.join();
+        ::close(wakePipe_[0]);
+        ::close(wakePipe_[1]);
+    }
+
+    AsyncBlockReader(const AsyncBlockReader&) = delete;
+    AsyncBlockReader& operator=(const AsyncBlockReader&) = delete;
+
+    /**
+     * Releases the previously returned chunk and waits for the next; empty at
+     * end of input. If nothing has arrived yet, `onIdle` (when set) runs
+     * first, without the lock held.
+     */
+    std::string_view next_chunk(const std::function<void()>& onIdle) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (holding_) {
+            head_ = (head_ + 1) % kBufferCount;
+            --filled_;
+            holding_ = false;
+            changed_.notify_all();
+        }
+        if (onIdle && filled_ == 0 && !finished_) {
+            lock.unlock();
+            onIdle();
+            lock.lock();
+        }
+        changed_.wait(lock, [&] { return filled_ > 0 || finished_; });
+        if (filled_ == 0) {
+            if (error_) throw std::system_error(error_, std::generic_category(), "read");
+            return {};
+        }
+        holding_ = true;
+        return std::string_view(buffers_[head_].data.data(), buffers_[head_].length);
+    }
+
+private:
+    static constexpr size_t kBufferCount = 3;
+
+    struct Buffer {
+        std::vector<char> data;
+        size_t length{0};
+    };
+
+    void run() {
+        size_t tail = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                changed_.wait(lock, [&] { return stopping_ || filled_ < kBufferCount; });
+                if (stopping_) return;
+            }
+
+            // buffers_[tail] is free, so it is safe to fill without the lock.
+            Buffer& buffer = buffers_[tail];
+            const ssize_t count = read_chunk(buffer.data);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (count <= 0) {
+                if (count < 0 && !stopping_) error_ = errno;
+                finished_ = true;
+                changed_.notify_all();
+                return;
+            }
+            buffer.length = static_cast<size_t>(count);
+            tail = (tail + 1) % kBufferCount;
+            ++filled_;
+            changed_.notify_all();
+        }
+    }
+
+    /// One read(2) into `data`; 0 at end of input, -1 on error or when woken for shutdown.
+    ssize_t read_chunk(std::vector<char>& data) {
+        pollfd fds[2] = {{fd_, POLLIN, 0}, {wakePipe_[0], POLLIN, 0}};
+        for (;;) {
+            if (::poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            if (fds[1].revents) return -1;
+            const ssize_t count = ::read(fd_, data.data(), data.size());
+            if (count < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+            return count;
+        }
+    }
+
+    int fd_;
+    int wakePipe_[2]{-1, -1};
+    Buffer buffers_[kBufferCount];
+    std::thread thread_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    size_t head_{0};        // oldest filled buffer
+    size_t filled_{0};      // filled buffers, including the one the consumer holds
+    bool holding_{false};
+    bool finished_{false};
+    bool stopping_{false};
+    int error_{0};
+};
+
+/**
+ * @brief Zero-copy source of command lines
+ *
+ * Regular files (including a redirected stdin) are memory-mapped and lines
+ * are handed out as views straight into the mapping. Pipes and terminals
+ * are read by an AsyncBlockReader thread in large chunks; lines are views
+ * into those chunks, and only a line that straddles two chunks is copied,
+ * into a reused carry buffer. Nothing is allocated per line.
+ */
+class CommandInput {
+public:
+    /// Reads from `path`, or from stdin when `path` is null.
+    explicit CommandInput(const char* path) {
+        if (path) {
+            fd_ = ::open(path, O_RDONLY);
+            if (fd_ < 0) throw std::system_error(errno, std::generic_category(), path);
+            ownsFd_ = true;
+        }
+
+        // An inherited stdin may already be partly read; input starts at its current offset.
+        struct stat info {};
+        const off_t offset = ::lseek(fd_, 0, SEEK_CUR);
+        if (::fstat(fd_, &info) == 0 && S_ISREG(info.st_mode) && offset >= 0 && offset < info.st_size) {
+            void* mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (mapping != MAP_FAILED) {
+                ::madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+                mapped_ = static_cast<const char*>(mapping);
+                mappedSize_ = static_cast<size_t>(info.st_size);
+                cursor_ = mapped_ + offset;
+                end_ = mapped_ + mappedSize_;
+                return;
+            }
+        }
+        reader_ = std::make_unique<AsyncBlockReader>(fd_, kBlockSize);
+    }
+
+    ~CommandInput() {
+        reader_.reset();
+        if (mapped_) ::munmap(const_cast<char*>(mapped_), mappedSize_);
+        if (ownsFd_) ::close(fd_);
+    }
+
+    CommandInput(const CommandInput&) = delete;
+    CommandInput& operator=(const CommandInput&) = delete;
+
+    /**
+     * Runs `onIdle` whenever the next line has not arrived yet and reading
+     * would block, so output produced so far can be pushed out instead of
+     * waiting behind a slow producer. Memory-mapped input never waits.
+     */
+    void set_idle_handler(std::function<void()> onIdle) { onIdle_ = std::move(onIdle); }
+
+    /**
+     * Yields the next line without its terminator, along with its field
+     * offsets, or the next WireUpdate record as a kSize-byte view (with no
+     * fields); false once input is exhausted. The view is valid until the
+     * next call.
+     */
+    bool next_line(std::string_view& line, LineFields& fields) {
+        for (;;) {
+            if (cursor_ == end_ && !pending_.empty()) {
+                cursor_ = pending_.data();
+                end_ = pending_.data() + pending_.size();
+                pending_ = {};
+                scanner_.reset();
+            }
+            if (cursor_ != end_ && static_cast<unsigned char>(*cursor_) == WireUpdate::kMarker) {
+                if (static_cast<size_t>(end_ - cursor_) >= WireUpdate::kSize) {
+                    line = std::string_view(cursor_, WireUpdate::kSize);
+                    fields.count = 0;
+                    cursor_ += WireUpdate::kSize;
+                    return true;
+                }
+                if (!carry_over(WireUpdate::kSize)) throw std::runtime_error("truncated binary update record");
+                scanner_.reset();
+                continue;
+            }
+            const size_t available = end_ - cursor_;
+            const size_t length = scanner_.scan(cursor_, end_, fields);
+            if (length < available) {
+                line = std::string_view(cursor_, length);
+                cursor_ += length + 1;
+                return true;
+            }
+            const bool continued = carry_over(0);
+            scanner_.reset();
+            if (!continued) {
+                if (cursor_ == end_) return false;
+                line = std::string_view(cursor_, end_ - cursor_);
+                scanner_.scan(cursor_, end_, fields);
+                cursor_ = end_;
+                return true;
+            }
+        }
+    }
+
+private:
+    static constexpr size_t kBlockSize = size_t{1} << 20;
+
+    /**
+     * Continues the unfinished unit at [cursor_, end_) from the next chunks:
+     * a text line when `recordSize` is 0, otherwise a binary record of that
+     * many bytes. The completed unit is assembled in carry_ and the rest of
+     * the chunk it ended in is kept in pending_. Returns false at end of
+     * input, leaving whatever was collected between cursor_ and end_.
+     */
+    bool carry_over(size_t recordSize) {
+        if (!reader_) return false;
+
+        if (cursor_ == end_) {
+            std::string_view chunk = reader_->next_chunk(onIdle_);
+            if (chunk.empty()) return false;
+            cursor_ = chunk.data();
+            end_ = chunk.data() + chunk.size();
+            return true;
+        }
+
+        carry_.assign(cursor_, end_);  // copy before the chunk is handed back
+        for (;;) {
+            std::string_view chunk = reader_->next_chunk(onIdle_);
+            if (chunk.empty()) {
+                cursor_ = carry_.data();
+                end_ = carry_.data() + carry_.size();
+                return false;
+            }
+
+            size_t take;
+            if (recordSize) {
+                take = std::min(recordSize - carry_.size(), chunk.size());
+            } else {
+                const size_t newline = chunk.find('\n');
+                take = newline == std::string_view::npos ? chunk.size() : newline + 1;
+            }
+            carry_.append(chunk.substr(0, take));
+
+            if (recordSize ? carry_.size() == recordSize : carry_.back() == '\n') {
+                pending_ = chunk.substr(take);
+                cursor_ = carry_.data();
+                end_ = carry_.data() + carry_.size();
+                return true;
+            }
+        }
+    }
+
+    int fd_{STDIN_FILENO};
+    bool ownsFd_{false};
+    const char* mapped_{nullptr};
+    size_t mappedSize_{0};
+    std::unique_ptr<AsyncBlockReader> reader_;  // set unless the input is memory-mapped
+    std::function<void()> onIdle_;
+    FieldScanner scanner_;
+    std::string carry_;
+    std::string_view pending_;
+    const char* cursor_{nullptr};
+    const char* end_{nullptr};
+};
+
+/**
+ * Parses `token` into `value` with the results operator>> gives: a leading
+ * '-' on an unsigned type negates the magnitude modulo 2^64 as strtoull does,
+ * out-of-range numbers saturate, and a token with no leading number reads as
+ * 0. Returns false unless the whole token was a number; `value` then holds
+ * the leading number, if any, and the caller must stop parsing the line
+ * there, just as a failed stream ignores every later extraction.
+ */
+template <typename T>
+bool parse_number(std::string_view token, T& value) {
+    const char* first = token.data();
+    const char* const last = first + token.size();
+    const bool negative = first != last && *first == '-';
+    if (first != last && (*first == '+' || *first == '-')) ++first;
+    if constexpr (std::is_floating_point_v<T>) {
+        // from_chars also takes "inf" and "nan", which operator>> rejects.
+        if (first == last || !((*first >= '0' && *first <= '9') || *first == '.')) {
+            value = T{};
+            return false;
+        }
+    }
+
+    T magnitude{};
+    const auto [end, error] = std::from_chars(first, last, magnitude);
+    if (error == std::errc::invalid_argument || first == last || *first == '-' || *first == '+') {
+        value = T{};
+        return false;
+    }
+    if (error == std::errc::result_out_of_range) {
+        if constexpr (std::is_floating_point_v<T>) {
+            // Only overflow fails the stream; strtod tells it apart from underflow.
+            const T parsed = std::strtod(std::string(first, end).c_str(), nullptr);
+            if (std::isinf(parsed)) {
+                value = negative ? std::numeric_limits<T>::lowest() : std::numeric_limits<T>::max();
+                return false;
+            }
+            magnitude = parsed;
+        } else {
+            value = negative && std::is_signed_v<T> ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+            return false;
+        }
+    }
+
+    if constexpr (std::is_unsigned_v<T>) {
+        value = negative ? T{0} - magnitude : magnitude;
+    } else {
+        value = negative ? -magnitude : magnitude;
+    }
+    return end == last;
+}
+
+#ifdef RAVEN_FIXED_POINT_PRICES
+/**
+ * Parses a price like parse_number() does, with integer arithmetic. Numbers
+ * with more than six decimals or an exponent are rare enough to go through
+ * the double parser and be rounded to the nearest micro. A number too large
+ * for a FixedPrice sets `outOfRange` and returns false.
+ */
+inline bool parse_price(std::string_view token, Price& value, bool& outOfRange) {
+    const char* cursor = token.data();
+    const char* const end = cursor + token.size();
+    const bool negative = cursor != end && *cursor == '-';
+    if (cursor != end && (*cursor == '+' || *cursor == '-')) ++cursor;
+
+    const auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+    const char* const digits = cursor;
+    uint64_t whole = 0;
+    for (; cursor != end && is_digit(*cursor); ++cursor) {
+        whole = whole * 10 + (*cursor - '0');
+        if (whole > static_cast<uint64_t>(FixedPrice::kMaxWhole)) {
+            outOfRange = true;
+            return false;
+        }
+    }
+    bool seenDigits = cursor != digits;
+
+    uint64_t fraction = 0;
+    int fractionDigits = 0;
+    if (cursor != end && *cursor == '.') {
+        for (++cursor; cursor != end && is_digit(*cursor); ++cursor, ++fractionDigits) {
+            if (fractionDigits == 6) break;
+            fraction = fraction * 10 + (*cursor - '0');
+        }
+        seenDigits = seenDigits || fractionDigits > 0;
+    }
+    if (!seenDigits) {
+        value = {};
+        return false;
+    }
+
+    if (cursor != end && (is_digit(*cursor) || *cursor == 'e' || *cursor == 'E')) {
+        double fallback;
+        const bool complete = parse_number(token, fallback);
+        if (!price_in_range(fallback)) {
+            outOfRange = true;
+            return false;
+        }
+        value = price_from_double(fallback);
+        return complete;
+    }
+
+    for (; fractionDigits < 6; ++fractionDigits) fraction *= 10;
+    const int64_t micros = static_cast<int64_t>(whole * FixedPrice::kScale + fraction);
+    value.micros = negative ? -micros : micros;
+    return cursor == end;
+}
+#else
+/// Parses a price with parse_number(); a double saturates as operator>> does, so nothing is out of range.
+inline bool parse_price(std::string_view token, Price& value, bool& /*outOfRange*/) {
+    return parse_number(token, value);
+}
+#endif
+
+/**
+ * @brief One parsed input line
+ *
+ * String fields are views into the input and are only valid until the next
+ * line is read.
+ */
+struct Command {
+    enum class Kind : uint8_t {
+        Ignored,        // blank or unrecognised line
+        Update,         // P <instrumentId> <lastTradedPrice> <extraValue>
+        Subscribe,      // S <type> <subscriberId> subscribe <instrumentId>
+        GetData,        // S <type> <subscriberId> get_data <instrumentId>
+        GetDataBatch,   // S <type> <subscriberId> get_data_batch <instrumentId> <instrumentId> ...
+        OtherAction,    // S line with any other action; still registers the subscriber
+        RejectedUpdate, // P line whose price does not fit the Price type
+    };
+
+    Kind kind{Kind::Ignored};
+    uint64_t instrumentId{0};
+    Price lastTradedPrice{};
+    Price extraValue{};
+    std::string_view type;
+    std::string_view subscriberId;
+    std::string_view instrumentIds;  // GetDataBatch: the rest of the line, see parse_instrument_ids()
+};
+
+Command parse_command(std::string_view line, const LineFields& fields) {
+    Command command;
+    if (WireUpdate::is_record(line)) {
+        const WireUpdate update = WireUpdate::decode(line.data());
+        if (update.messageType != WireUpdate::kTypeUpdate) return command;
+        if (!price_in_range(update.lastTradedPrice) || !price_in_range(update.extraValue)) {
+            command.kind = Command::Kind::RejectedUpdate;
+            return command;
+        }
+        command.kind = Command::Kind::Update;
+        command.instrumentId = update.instrumentId;
+        command.lastTradedPrice = price_from_double(update.lastTradedPrice);
+        command.extraValue = price_from_double(update.extraValue);
+        return command;
+    }
+
+    std::string_view verb = fields.get(line, 0);
+
+    if (verb == "P") {
+        bool outOfRange = false;
+        parse_number(fields.get(line, 1), command.instrumentId) &&
+            parse_price(fields.get(line, 2), command.lastTradedPrice, outOfRange) &&
+            parse_price(fields.get(line, 3), command.extraValue, outOfRange);
+        command.kind = outOfRange ? Command::Kind::RejectedUpdate : Command::Kind::Update;
+    } else if (verb == "S") {
+        command.type = fields.get(line, 1);
+        command.subscriberId = fields.get(line, 2);
+        std::string_view action = fields.get(line, 3);
+        parse_number(fields.get(line, 4), command.instrumentId);
+
+        if (action == "get_data") {
+            command.kind = Command::Kind::GetData;
+        } else if (action == "get_data_batch") {
+            command.kind = Command::Kind::GetDataBatch;
+            if (fields.count > 4) command.instrumentIds = line.substr(fields.begin[4]);
+        } else if (action == "subscribe") {
+            command.kind = Command::Kind::Subscribe;
+        } else {
+            command.kind = Command::Kind::OtherAction;
+        }
+    }
+    return command;
+}
+
+/// Splits a get_data_batch ID list on whitespace into `ids`, each parsed as the ID of a get_data.
+void parse_instrument_ids(std::string_view text, std::vector<uint64_t>& ids) {
+    constexpr std::string_view kWhitespace = " \t\n\v\f\r";
+    ids.clear();
+    for (size_t begin = text.find_first_not_of(kWhitespace); begin != std::string_view::npos;) {
+        const size_t end = std::min(text.find_first_of(kWhitespace, begin), text.size());
+        uint64_t id = 0;
+        parse_number(text.substr(begin, end - begin), id);
+        ids.push_back(id);
+        begin = text.find_first_not_of(kWhitespace, end);
+    }
+}
+
+/// Writes the response for a get_data that never reached a valid subscriber.
+void write_invalid_request(OutputSink& out, SubscriberHandle handle, std::string_view type,
+                           std::string_view subscriberId, uint64_t instrumentId) {
+    if (out.binary_responses()) {
+        WireResponse response{};
+        response.subscriber = handle;
+        response.status = WireResponse::kStatusInvalidRequest;
+        response.subscriberType = type.empty() ? '\0' : type.front();
+        response.instrumentId = instrumentId;
+        response.write_to(out);
+        return;
+    }
+
+    out.append(type);
+    out.append(',');
+    out.append(subscriberId);
+    out.append(',');
+    out.append_uint(instrumentId);
+    out.append(",invalid_request");
+    out.end_record();
+}
+
+/**
+ * @brief Rewrites a command stream with every text `P` line replaced by a WireUpdate record
+ *
+ * The header, `S` lines and records that are already binary pass through
+ * unchanged. Records are numbered from zero in stream order.
+ */
+void encode_updates(CommandInput& input, OutputSink& out) {
+    std::string_view line;
+    LineFields fields;
+    uint32_t sequence = 0;
+    bool header = true;
+    while (input.next_line(line, fields)) {
+        out.maybe_flush();
+        if (WireUpdate::is_record(line)) {
+            out.append(line);
+            continue;
+        }
+        if (!header) {
+            const Command command = parse_command(line, fields);
+            if (command.kind == Command::Kind::Update) {
+                WireUpdate update;
+                update.sequence = sequence++;
+                update.instrumentId = command.instrumentId;
+                update.lastTradedPrice = price_to_double(command.lastTradedPrice);
+                update.extraValue = price_to_double(command.extraValue);
+                char record[WireUpdate::kSize];
+                update.encode(record);
+                out.append(std::string_view(record, sizeof(record)));
+                continue;
+            }
+        }
+        header = false;
+        out.append(line);
+        out.end_record();
+    }
+}
+
+/**
+ * @brief Log-linear latency histogram in the style of HdrHistogram
+ *
+ * Values below 2^kSubBucketBits nanoseconds get exact buckets; each power of
+ * two above that is split into 2^(kSubBucketBits - 1) linear sub-buckets, so
+ * a reported value is at most ~3% above the true one. Recording is a single
+ * bucket increment. Each histogram has one writing thread; counts are relaxed
+ * atomics so another thread may read a consistent-enough copy at any time.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 6;
+    static constexpr size_t kBucketCount = size_t{66 - kSubBucketBits} << (kSubBucketBits - 1);
+
+    void record(uint64_t nanoseconds) {
+        auto& count = counts_[bucket_of(nanoseconds)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (nanoseconds > max_.load(std::memory_order_relaxed)) max_.store(nanoseconds, std::memory_order_relaxed);
+    }
+
+    /// Plain copy of one or more histograms, used to compute percentiles.
+    struct Snapshot {
+        std::vector<uint64_t> counts = std::vector<uint64_t>(kBucketCount);
+        uint64_t total{0};
+        uint64_t max{0};
+
+        /// Smallest recorded value (bucket upper bound) with at least `quantile` of samples at or below it.
+        uint64_t value_at(double quantile) const {
+            if (total == 0) return 0;
+            const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * total)));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < kBucketCount; ++i) {
+                seen += counts[i];
+                if (seen >= rank) return std::min(highest_equivalent(i), max);
+            }
+            return max;
+        }
+    };
+
+    void add_to(Snapshot& snapshot) const {
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            const uint64_t count = counts_[i].load(std::memory_order_relaxed);
+            snapshot.counts[i] += count;
+            snapshot.total += count;
+        }
+        snapshot.max = std::max(snapshot.max, max_.load(std::memory_order_relaxed));
+    }
+
+private:
+    static size_t bucket_of(uint64_t value) {
+        if (value < (uint64_t{1} << kSubBucketBits)) return value;
+        const unsigned shift = std::bit_width(value) - kSubBucketBits;
+        return (size_t{shift} << (kSubBucketBits - 1)) + (value >> shift);
+    }
+
+    static uint64_t highest_equivalent(size_t bucket) {
+        if (bucket < (size_t{1} << kSubBucketBits)) return bucket;
+        const unsigned shift = (bucket >> (kSubBucketBits - 1)) - 1;
+        const uint64_t subBucket = bucket - (size_t{shift} << (kSubBucketBits - 1));
+        return ((subBucket + 1) << shift) - 1;
+    }
+
+    std::array<std::atomic<uint64_t>, kBucketCount> counts_{};
+    std::atomic<uint64_t> max_{0};
+};
+
+/**
+ * @brief Per-thread latency histograms of publisher calls, aggregated on demand
+ *
+ * Each thread executing commands owns one Recorder, holding a histogram per
+ * operation and publisher (asset class). report() merges all recorders and prints
+ * p50/p99/p99.9/max per histogram. A SIGUSR1 handler only raises a flag;
+ * the main thread notices it between commands and prints the report then.
+ */
+class LatencyMonitor {
+public:
+    // get_data includes formatting the response; get_data_batch is one publisher call per asset class in the batch
+    enum class Operation : uint8_t { UpdateData, Subscribe, GetData, GetDataBatch };
+    static constexpr size_t kOperations = 4;
+
+    struct Recorder {
+        explicit Recorder(size_t publishers) : publishers(publishers), histograms(kOperations * publishers) {}
+
+        size_t publishers;
+        std::vector<LatencyHistogram> histograms;  // [operation][publisher]
+
+        LatencyHistogram& histogram(size_t operation, size_t publisher) {
+            return histograms[operation * publishers + publisher];
+        }
+
+        /// Runs `call` and records how long it took against `operation` on publisher number `publisher`.
+        template <typename Call>
+        void time(Operation operation, size_t publisher, Call&& call) {
+            const auto start = std::chrono::steady_clock::now();
+            call();
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            histogram(static_cast<size_t>(operation), publisher)
+                .record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    };
+
+    /// `publisherNames` labels the publisher numbers passed to Recorder::time().
+    explicit LatencyMonitor(std::vector<std::string> publisherNames) : publisherNames_(std::move(publisherNames)) {}
+
+    /// A recorder for the calling thread; stays valid for the monitor's lifetime.
+    Recorder& add_thread() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return recorders_.emplace_back(publisherNames_.size());
+    }
+
+    void report(std::ostream& out) const {
+        static constexpr const char* kOperationNames[kOperations] = {"update_data", "subscribe", "get_data",
+                                                                     "get_data_batch"};
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-26s %12s %10s %10s %10s %10s\n", "latency (ns)", "count", "p50", "p99",
+                      "p99.9", "max");
+        out << line;
+        for (size_t operation = 0; operation < kOperations; ++operation) {
+            for (size_t publisher = 0; publisher < publisherNames_.size(); ++publisher) {
+                LatencyHistogram::Snapshot snapshot;
+                for (const Recorder& recorder : recorders_) {
+                    recorder.histograms[operation * recorder.publishers + publisher].add_to(snapshot);
+                }
+                if (snapshot.total == 0) continue;
+                const std::string name = std::string(kOperationNames[operation]) + " " + publisherNames_[publisher];
+                std::snprintf(line, sizeof(line), "%-26s %12llu %10llu %10llu %10llu %10llu\n", name.c_str(),
+                              static_cast<unsigned long long>(snapshot.total),
+                              static_cast<unsigned long long>(snapshot.value_at(0.5)),
+                              static_cast<unsigned long long>(snapshot.value_at(0.99)),
+                              static_cast<unsigned long long>(snapshot.value_at(0.999)),
+                              static_cast<unsigned long long>(snapshot.max));
+                out << line;
+            }
+        }
+        out.flush();
+    }
+
+    /// Makes SIGUSR1 request a report.
+    static void install_signal_handler() { std::signal(SIGUSR1, [](int) { reportRequested_ = 1; }); }
+
+    /// True once per received SIGUSR1.
+    static bool take_report_request() {
+        if (!reportRequested_) return false;
+        reportRequested_ = 0;
+        return true;
+    }
+
+private:
+    const std::vector<std::string> publisherNames_;
+    mutable std::mutex mutex_;
+    std::deque<Recorder> recorders_;
+    inline static volatile std::sig_atomic_t reportRequested_ = 0;
+};
+
+/**
+ * @brief Engine counters, kept per thread and summed into snapshots on demand
+ *
+ * Each thread executing commands owns one Counters block on its own cache
+ * line; incrementing is a relaxed load and store with no read-modify-write.
+ * snapshot() may run on any thread and sees slightly stale values at worst.
+ * With start_reporting() a background thread appends a snapshot line to a
+ * file descriptor at a fixed interval, and a last one when reporting stops.
+ */
+class EngineMetrics {
+public:
+    enum class Counter : uint8_t {
+        UpdatesApplied,
+        UpdatesRejected,
+        SubscriptionsAdded,
+        SubscriptionsRejected,
+        GetDataHits,
+        GetDataMisses,
+        InvalidBadRange,
+        InvalidNotSubscribed,
+        InvalidNoData,
+        InvalidQuotaExhausted,
+        InvalidTypeMismatch,
+        FreeQuotaExhausted,  // free subscribers that used up their last request
+        PushesConflated,     // pushed updates overwritten by a newer one before delivery
+        PushesDropped,       // pushed updates not delivered because a free quota was used up
+    };
+    static constexpr size_t kCounters = 14;
+
+    struct alignas(64) Counters {
+        std::array<std::atomic<uint64_t>, kCounters> values{};
+
+        void add(Counter counter, uint64_t amount = 1) {
+            auto& value = values[static_cast<size_t>(counter)];
+            value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+
+        /// Counts a get_data outcome: a hit, or a miss together with its invalid_request reason.
+        void count_lookup(LookupStatus status) {
+            if (status == LookupStatus::Ok) {
+                add(Counter::GetDataHits);
+                return;
+            }
+            add(Counter::GetDataMisses);
+            switch (status) {
+            case LookupStatus::BadRange: add(Counter::InvalidBadRange); break;
+            case LookupStatus::NotSubscribed: add(Counter::InvalidNotSubscribed); break;
+            case LookupStatus::NoData: add(Counter::InvalidNoData); break;
+            case LookupStatus::QuotaExhausted: add(Counter::InvalidQuotaExhausted); break;
+            case LookupStatus::TypeMismatch: add(Counter::InvalidTypeMismatch); break;
+            case LookupStatus::Ok: break;
+            }
+        }
+    };
+
+    EngineMetrics() = default;
+    EngineMetrics(const EngineMetrics&) = delete;
+    EngineMetrics& operator=(const EngineMetrics&) = delete;
+
+    ~EngineMetrics() { stop_reporting(); }
+
+    /// Counters for the calling thread; they stay valid for the lifetime of this object.
+    Counters& add_thread() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return counters_.emplace_back();
+    }
+
+    std::array<uint64_t, kCounters> snapshot() const {
+        std::array<uint64_t, kCounters> totals{};
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const Counters& counters : counters_) {
+            for (size_t i = 0; i < kCounters; ++i) totals[i] += counters.values[i].load(std::memory_order_relaxed);
+        }
+        return totals;
+    }
+
+    /// Appends one snapshot as a line of name=value pairs, prefixed with the elapsed time.
+    void write_snapshot(int fd) const {
+        static constexpr const char* kNames[kCounters] = {
+            "updates_applied", "updates_rejected", "subscriptions_added", "subscriptions_rejected",
+            "get_data_hits", "get_data_misses", "invalid_request.bad_range", "invalid_request.not_subscribed",
+            "invalid_request.no_data", "invalid_request.quota_exhausted", "invalid_request.type_mismatch",
+            "free_quota_exhausted", "pushes_conflated", "pushes_dropped"};
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started_);
+        std::string line = "metrics elapsed_ms=" + std::to_string(elapsed.count());
+        const auto totals = snapshot();
+        for (size_t i = 0; i < kCounters; ++i) line += std::string(" ") + kNames[i] + "=" + std::to_string(totals[i]);
+        line += '\n';
+        for (size_t written = 0; written < line.size();) {
+            const ssize_t n = ::write(fd, line.data() + written, line.size() - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;  // metrics are best effort; never fail the run over them
+            written += n;
+        }
+    }
+
+    void start_reporting(int fd, std::chrono::milliseconds interval) {
+        reportFd_ = fd;
+        reporter_ = std::thread([this, interval] {
+            std::unique_lock<std::mutex> lock(reporterMutex_);
+            while (!reporterStopping_) {
+                if (!reporterWake_.wait_for(lock, interval, [&] { return reporterStopping_; })) write_snapshot(reportFd_);
+            }
+        });
+    }
+
+    /// Stops the reporting thread, if any, after writing a final snapshot.
+    void stop_reporting() {
+        if (!reporter_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(reporterMutex_);
+            reporterStopping_ = true;
+        }
+        reporterWake_.notify_all();
+        reporter_.join();
+        write_snapshot(reportFd_);
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::deque<Counters> counters_;
+    const std::chrono::steady_clock::time_point started_ = std::chrono::steady_clock::now();
+
+    int reportFd_{-1};
+    std::thread reporter_;
+    std::mutex reporterMutex_;
+    std::condition_variable reporterWake_;
+    bool reporterStopping_{false};
+};
+
+/**
+ * @brief Command-line configuration
+ */
+struct Options {
+    const char* inputPath{nullptr};  // stdin when null
+    bool pushMode{false};
+    size_t pushQueueCapacity{256};
+    uint64_t pushInterval{1};        // commands between push deliveries
+    size_t shards{1};                // worker threads; 1 runs everything on the main thread
+    bool encodeUpdates{false};       // convert the input with encode_updates() instead of running it
+    bool binaryOutput{false};        // write WireResponse records instead of CSV lines
+    bool latency{false};             // time publisher calls and report percentiles on exit and SIGUSR1
+    const char* metricsPath{nullptr};  // append counter snapshots here ("-" for stderr); none when null
+    std::chrono::milliseconds metricsInterval{1000};
+};
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--push") {
+            options.pushMode = true;
+        } else if (arg == "--encode-updates") {
+            options.encodeUpdates = true;
+        } else if (arg == "--binary-output") {
+            options.binaryOutput = true;
+        } else if (arg == "--latency") {
+            options.latency = true;
+        } else if (arg.substr(0, 10) == "--metrics=") {
+            options.metricsPath = argv[i] + 10;
+        } else if (arg.substr(0, 19) == "--metrics-interval=") {
+            uint64_t milliseconds = 0;
+            const std::string_view value = arg.substr(19);
+            if (value.starts_with('-') || !parse_number(value, milliseconds) || milliseconds == 0) {
+                throw std::invalid_argument("--metrics-interval expects a positive number of milliseconds");
+            }
+            options.metricsInterval = std::chrono::milliseconds(milliseconds);
+        } else if (arg.substr(0, 7) == "--simd=") {
+            if (!FieldScanner::select(arg.substr(7))) {
+                throw std::invalid_argument("--simd: '" + std::string(arg.substr(7)) + "' is not available on this CPU");
+            }
+        } else if (arg.substr(0, 16) == "--push-interval=") {
+            const std::string_view value = arg.substr(16);
+            if (value.starts_with('-') || !parse_number(value, options.pushInterval) || options.pushInterval == 0) {
+                throw std::invalid_argument("--push-interval expects a positive number of commands");
+            }
+        } else if (arg.substr(0, 9) == "--shards=") {
+            const std::string_view value = arg.substr(9);
+            if (value.starts_with('-') || !parse_number(value, options.shards) || options.shards == 0) {
+                throw std::invalid_argument("--shards expects a positive integer");
+            }
+        } else if (arg.substr(0, 2) == "--" || options.inputPath) {
+            throw std::invalid_argument("unexpected argument '" + std::string(arg) + "'");
+        } else {
+            options.inputPath = argv[i];
+        }
+    }
+    if (options.pushMode && options.shards > 1) {
+        throw std::invalid_argument("--push cannot be combined with --shards");
+    }
+    return options;
+}
+
+/**
+ * @brief Owns the publishers and subscribers and executes commands in order
+ */
+class MarketDataEngine {
+public:
+    explicit MarketDataEngine(const Options& options) : options_(options) {
+        assetClasses_.add("equity", equity_);
+        assetClasses_.add("bond", bond_);
+
+        if (options_.pushMode) {
+            for (size_t i = 0; i < assetClasses_.size(); ++i) assetClasses_.publisher(i)->set_listener(&subscribers_);
+        }
+        if (options_.latency) {
+            std::vector<std::string> names;
+            for (size_t i = 0; i < assetClasses_.size(); ++i) names.push_back(assetClasses_.name(i));
+            names.push_back("unassigned");
+            latency_ = std::make_unique<LatencyMonitor>(std::move(names));
+            recorder_ = &latency_->add_thread();
+            LatencyMonitor::install_signal_handler();
+        }
+        if (options_.metricsPath) {
+            const std::string_view path = options_.metricsPath;
+            metricsFd_ = path == "-" ? STDERR_FILENO : ::open(options_.metricsPath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (metricsFd_ < 0) throw std::system_error(errno, std::generic_category(), options_.metricsPath);
+            metrics_.start_reporting(metricsFd_, options_.metricsInterval);
+        }
+    }
+
+    ~MarketDataEngine() {
+        metrics_.stop_reporting();
+        if (metricsFd_ > STDERR_FILENO) ::close(metricsFd_);
+    }
+
+    MarketDataEngine(const MarketDataEngine&) = delete;
+    MarketDataEngine& operator=(const MarketDataEngine&) = delete;
+
+    EngineMetrics& metrics() { return metrics_; }
+
+    /// The main thread's counters.
+    EngineMetrics::Counters& counters() { return counters_; }
+
+    /// Counts the outcome of a get_data answered for `subscriber`, noting when it used up a free quota.
+    void count_get_data(const Subscriber& subscriber, LookupStatus status) {
+        counters_.count_lookup(status);
+        if (status == LookupStatus::Ok && subscriber.quota_exhausted()) {
+            counters_.add(EngineMetrics::Counter::FreeQuotaExhausted);
+        }
+    }
+
+    /// Latency histograms, or null unless --latency was given.
+    LatencyMonitor* latency() const { return latency_.get(); }
+
+    /// Prints the latency report if a SIGUSR1 arrived since the last call.
+    void poll_latency_report() const {
+        if (latency_ && LatencyMonitor::take_report_request()) latency_->report(std::cerr);
+    }
+
+    /**
+     * Calls `fn` with the publisher owning `instrumentId`: as its concrete
+     * AssetPublisher type for the built-in asset classes, so the call is
+     * resolved statically, or as a Publisher& for plugin classes and
+     * unassigned IDs.
+     */
+    template <typename Fn>
+    decltype(auto) with_publisher(uint64_t instrumentId, Fn&& fn) const {
+        switch (assetClasses_.class_of(instrumentId)) {
+        case kEquityClass: return fn(*equity_);
+        case kBondClass: return fn(*bond_);
+        default: return fn(*assetClasses_.publisher_for(instrumentId));
+        }
+    }
+
+    /**
+     * Answers a get_data for a resolved subscriber, with the same quota rules
+     * as Subscriber::get_data() but a statically dispatched lookup.
+     */
+    LookupStatus answer_get_data(Subscriber& subscriber, uint64_t instrumentId, OutputSink& out) const {
+        if (subscriber.quota_exhausted()) {
+            subscriber.print_result(out, false, instrumentId, Quote());
+            return LookupStatus::QuotaExhausted;
+        }
+        Quote quote;
+        const LookupStatus status = with_publisher(instrumentId, [&](const auto& publisher) {
+            return publisher.lookup(subscriber.handle(), instrumentId, quote);
+        });
+        if (status == LookupStatus::Ok) subscriber.consume_request();
+        subscriber.print_result(out, status == LookupStatus::Ok, instrumentId, quote);
+        return status;
+    }
+
+    /**
+     * Answers a get_data_batch for a resolved subscriber. Each run of
+     * consecutive IDs in the same asset class is looked up with one
+     * Publisher::get_data_batch call; the answers are then charged against
+     * the quota and printed one line per instrument, exactly as the
+     * equivalent sequence of get_data commands would be.
+     */
+    void answer_get_data_batch(Subscriber& subscriber, std::span<const uint64_t> instrumentIds, OutputSink& out) {
+        batchResults_.resize(instrumentIds.size());
+        for (size_t begin = 0; begin < instrumentIds.size();) {
+            const uint8_t assetClass = assetClasses_.class_of(instrumentIds[begin]);
+            size_t end = begin + 1;
+            while (end < instrumentIds.size() && assetClasses_.class_of(instrumentIds[end]) == assetClass) ++end;
+            const auto lookup_run = [&] {
+                with_publisher(instrumentIds[begin], [&](const auto& publisher) {
+                    publisher.get_data_batch(subscriber.handle(), instrumentIds.subspan(begin, end - begin),
+                                             std::span(batchResults_).subspan(begin, end - begin));
+                });
+            };
+            if (recorder_) {
+                recorder_->time(LatencyMonitor::Operation::GetDataBatch, publisher_index(instrumentIds[begin]),
+                                lookup_run);
+            } else {
+                lookup_run();
+            }
+            begin = end;
+        }
+
+        for (size_t i = 0; i < instrumentIds.size(); ++i) {
+            LookupStatus status = batchResults_[i].status;
+            if (subscriber.quota_exhausted()) {
+                status = LookupStatus::QuotaExhausted;
+            } else if (status == LookupStatus::Ok) {
+                subscriber.consume_request();
+            }
+            subscriber.print_result(out, status == LookupStatus::Ok, instrumentIds[i], batchResults_[i].quote);
+            count_get_data(subscriber, status);
+        }
+    }
+
+    /// Asset class index of `instrumentId` for latency recording, with unassigned IDs numbered last.
+    size_t publisher_index(uint64_t instrumentId) const {
+        const uint8_t index = assetClasses_.class_of(instrumentId);
+        return index == AssetClassRegistry::kUnassigned ? assetClasses_.size() : index;
+    }
+
+    /**
+     * Interns the subscriber named by an S command into `handle`, creating
+     * the subscriber on first sight. Returns null when the type is unknown or
+     * differs from the type the subscriber was first seen with.
+     */
+    Subscriber* resolve_subscriber(const Command& command, SubscriberHandle& handle) {
+        handle = symbols_.intern(command.subscriberId);
+        auto& subscriber = subscribers_.slot(handle);
+
+        if (subscriber) {
+            if (command.type.empty() || subscriber->get_type() != command.type.front()) return nullptr;
+        } else if (command.type == "P" || command.type == "F") {
+            if (command.type == "P") {
+                subscriber = std::make_shared<PaidSubscriber>(handle, command.subscriberId);
+            } else {
+                subscriber = std::make_shared<FreeSubscriber>(handle, command.subscriberId);
+            }
+            if (options_.pushMode) subscriber->enable_push(options_.pushQueueCapacity);
+        }
+        return subscriber.get();
+    }
+
+    void execute(const Command& command, OutputSink& out) {
+        if (recorder_) {
+            execute_timed(command, out);
+        } else {
+            execute_untimed(command, out);
+        }
+        if (options_.pushMode && ++commandsSinceDelivery_ >= options_.pushInterval) deliver_pushes(out);
+    }
+
+    /// Prints every queued push-mode update and counts what was conflated, dropped or used up a free quota.
+    void deliver_pushes(OutputSink& out) {
+        using Counter = EngineMetrics::Counter;
+        commandsSinceDelivery_ = 0;
+        subscribers_.drain(out);
+        const SubscriberDirectory::PushStats stats = subscribers_.take_push_stats();
+        counters_.add(Counter::PushesConflated, stats.conflated);
+        counters_.add(Counter::PushesDropped, stats.dropped);
+        counters_.add(Counter::FreeQuotaExhausted, stats.quotasExhausted);
+    }
+
+private:
+    void execute_untimed(const Command& command, OutputSink& out) {
+        using Counter = EngineMetrics::Counter;
+        switch (command.kind) {
+        case Command::Kind::Update: {
+            const bool applied = with_publisher(command.instrumentId, [&](auto& publisher) {
+                return publisher.update_data(command.instrumentId, command.lastTradedPrice, command.extraValue);
+            });
+            counters_.add(applied ? Counter::UpdatesApplied : Counter::UpdatesRejected);
+            break;
+        }
+        case Command::Kind::RejectedUpdate:
+            counters_.add(Counter::UpdatesRejected);
+            break;
+        case Command::Kind::Subscribe:
+        case Command::Kind::GetData:
+        case Command::Kind::GetDataBatch:
+        case Command::Kind::OtherAction: {
+            SubscriberHandle handle;
+            Subscriber* subscriber = resolve_subscriber(command, handle);
+            if (command.kind == Command::Kind::GetData) {
+                if (subscriber) {
+                    count_get_data(*subscriber, answer_get_data(*subscriber, command.instrumentId, out));
+                } else {
+                    write_invalid_request(out, handle, command.type, command.subscriberId, command.instrumentId);
+                    counters_.count_lookup(LookupStatus::TypeMismatch);
+                }
+            } else if (command.kind == Command::Kind::GetDataBatch) {
+                execute_get_data_batch(command, subscriber, handle, out);
+            } else if (command.kind == Command::Kind::Subscribe) {
+                const bool added = subscriber && with_publisher(command.instrumentId, [&](auto& publisher) {
+                    return publisher.subscribe(handle, command.instrumentId);
+                });
+                counters_.add(added ? Counter::SubscriptionsAdded : Counter::SubscriptionsRejected);
+            }
+            break;
+        }
+        case Command::Kind::Ignored:
+            break;
+        }
+    }
+
+    void execute_get_data_batch(const Command& command, Subscriber* subscriber, SubscriberHandle handle,
+                                OutputSink& out) {
+        parse_instrument_ids(command.instrumentIds, batchIds_);
+        if (subscriber) {
+            answer_get_data_batch(*subscriber, batchIds_, out);
+            return;
+        }
+        for (uint64_t id : batchIds_) {
+            write_invalid_request(out, handle, command.type, command.subscriberId, id);
+            counters_.count_lookup(LookupStatus::TypeMismatch);
+        }
+    }
+
+    /// execute() with each publisher call recorded in the latency histograms.
+    void execute_timed(const Command& command, OutputSink& out) {
+        using Counter = EngineMetrics::Counter;
+        using Operation = LatencyMonitor::Operation;
+        const uint64_t id = command.instrumentId;
+        const size_t timed = publisher_index(id);
+        switch (command.kind) {
+        case Command::Kind::Update: {
+            bool applied = false;
+            recorder_->time(Operation::UpdateData, timed, [&] {
+                applied = with_publisher(id, [&](auto& publisher) {
+                    return publisher.update_data(id, command.lastTradedPrice, command.extraValue);
+                });
+            });
+            counters_.add(applied ? Counter::UpdatesApplied : Counter::UpdatesRejected);
+            break;
+        }
+        case Command::Kind::RejectedUpdate:
+            counters_.add(Counter::UpdatesRejected);
+            break;
+        case Command::Kind::Subscribe:
+        case Command::Kind::GetData:
+        case Command::Kind::GetDataBatch:
+        case Command::Kind::OtherAction: {
+            SubscriberHandle handle;
+            Subscriber* subscriber = resolve_subscriber(command, handle);
+            if (command.kind == Command::Kind::GetData) {
+                if (subscriber) {
+                    LookupStatus status;
+                    recorder_->time(Operation::GetData, timed, [&] { status = answer_get_data(*subscriber, id, out); });
+                    count_get_data(*subscriber, status);
+                } else {
+                    write_invalid_request(out, handle, command.type, command.subscriberId, id);
+                    counters_.count_lookup(LookupStatus::TypeMismatch);
+                }
+            } else if (command.kind == Command::Kind::GetDataBatch) {
+                execute_get_data_batch(command, subscriber, handle, out);
+            } else if (command.kind == Command::Kind::Subscribe) {
+                bool added = false;
+                if (subscriber) {
+                    recorder_->time(Operation::Subscribe, timed, [&] {
+                        added = with_publisher(id, [&](auto& publisher) { return publisher.subscribe(handle, id); });
+                    });
+                }
+                counters_.add(added ? Counter::SubscriptionsAdded : Counter::SubscriptionsRejected);
+            }
+            break;
+        }
+        case Command::Kind::Ignored:
+            break;
+        }
+    }
+
+    static constexpr uint8_t kEquityClass = 0;  // registration order of the built-in classes
+    static constexpr uint8_t kBondClass = 1;
+
+    Options options_;
+    std::shared_ptr<EquityPublisher> equity_ = std::make_shared<EquityPublisher>();
+    std::shared_ptr<BondPublisher> bond_ = std::make_shared<BondPublisher>();
+    AssetClassRegistry assetClasses_;
+    SubscriberSymbols symbols_;
+    SubscriberDirectory subscribers_;
+    std::unique_ptr<LatencyMonitor> latency_;
+    LatencyMonitor::Recorder* recorder_{nullptr};  // the main thread's, when latency_ is set
+    EngineMetrics metrics_;
+    EngineMetrics::Counters& counters_{metrics_.add_thread()};
+    int metricsFd_{-1};
+    uint64_t commandsSinceDelivery_{0};
+    std::vector<uint64_t> batchIds_;          // reused by every get_data_batch
+    std::vector<LookupResult> batchResults_;
+};
+
+/**
+ * @brief Runs publisher work on worker threads, one shard of instruments each
+ *
+ * The main thread parses commands, resolves subscribers and routes each
+ * update, subscribe and get_data to the shard owning its instrument; shards
+ * own interleaved 64-ID blocks, so they never touch the same instrument
+ * slot or subscriber bitmap. Commands are handed over in batches, see
+ * launch() for how batches overlap.
+ *
+ * Every command is tagged with its input sequence number. Workers format
+ * their get_data responses into per-shard text buffers, and stitch()
+ * interleaves those buffers back into input order. The free-tier quota is
+ * charged while stitching, because whether a response is the 101st success
+ * depends on global order; the rare response that exceeds the quota is
+ * reformatted as invalid_request there. Output is therefore identical to
+ * running serially.
+ */
+class ShardedEngine {
+public:
+    ShardedEngine(MarketDataEngine& engine, size_t shardCount, bool binaryResponses)
+        : engine_(engine), shardCount_(shardCount) {
+        for (Batch& batch : batches_) {
+            batch.tasks.resize(shardCount_);
+            for (size_t i = 0; i <= shardCount_; ++i) {
+                batch.streams.push_back(std::make_unique<Stream>());
+                batch.streams.back()->text.set_binary_responses(binaryResponses);
+            }
+        }
+        for (size_t i = 0; i < shardCount_; ++i) {
+            workers_.emplace_back([this, i] { run_worker(i); });
+        }
+    }
+
+    ~ShardedEngine() {
+        wait_idle();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        start_.notify_all();
+        for (std::thread& worker : workers_) worker.join();
+    }
+
+    ShardedEngine(const ShardedEngine&) = delete;
+    ShardedEngine& operator=(const ShardedEngine&) = delete;
+
+    void submit(const Command& command, OutputSink& out) {
+        if (command.kind == Command::Kind::Ignored) return;
+        if (command.kind == Command::Kind::RejectedUpdate) {
+            engine_.counters().add(EngineMetrics::Counter::UpdatesRejected);
+            return;
+        }
+        const uint64_t sequence = nextSequence_++;
+        Batch& batch = batches_[filling_];
+
+        if (command.kind == Command::Kind::Update) {
+            route(batch, {command.kind, sequence, nullptr, command.instrumentId,
+                          command.lastTradedPrice, command.extraValue});
+        } else {
+            SubscriberHandle handle;
+            Subscriber* subscriber = engine_.resolve_subscriber(command, handle);
+            if (command.kind == Command::Kind::GetData) {
+                if (subscriber) {
+                    route(batch, {command.kind, sequence, subscriber, command.instrumentId, {}, {}});
+                } else {
+                    // The views in `command` die with the input line, so format the response now.
+                    Stream& stream = *batch.streams[shardCount_];
+                    write_invalid_request(stream.text, handle, command.type, command.subscriberId,
+                                          command.instrumentId);
+                    stream.responses.push_back({sequence, stream.text.contents().size(), nullptr, 0,
+                                                LookupStatus::TypeMismatch});
+                    engine_.counters().count_lookup(LookupStatus::TypeMismatch);
+                }
+            } else if (command.kind == Command::Kind::GetDataBatch) {
+                // Each instrument goes to its own shard, so the batch becomes one get_data task per instrument.
+                parse_instrument_ids(command.instrumentIds, batchIds_);
+                for (size_t i = 0; i < batchIds_.size(); ++i) {
+                    const uint64_t id = batchIds_[i];
+                    const uint64_t idSequence = i == 0 ? sequence : nextSequence_++;
+                    if (subscriber) {
+                        route(batch, {Command::Kind::GetData, idSequence, subscriber, id, {}, {}});
+                        continue;
+                    }
+                    Stream& stream = *batch.streams[shardCount_];
+                    write_invalid_request(stream.text, handle, command.type, command.subscriberId, id);
+                    stream.responses.push_back({idSequence, stream.text.contents().size(), nullptr, 0,
+                                                LookupStatus::TypeMismatch});
+                    engine_.counters().count_lookup(LookupStatus::TypeMismatch);
+                }
+            } else if (command.kind == Command::Kind::Subscribe) {
+                if (subscriber) {
+                    route(batch, {command.kind, sequence, subscriber, command.instrumentId, {}, {}});
+                } else {
+                    engine_.counters().add(EngineMetrics::Counter::SubscriptionsRejected);
+                }
+            }
+        }
+
+        if (++batched_ >= kBatchSize) launch(out);
+    }
+
+    /**
+     * Processes whatever is batched, even a partial batch, and writes out all
+     * outstanding responses. Called at end of input and whenever the input
+     * runs dry, so a slow producer is not left waiting for kBatchSize commands.
+     */
+    void flush(OutputSink& out) {
+        if (batched_ > 0) launch(out);
+        wait_idle();
+        if (inFlight_) stitch(batches_[1 - filling_], out);
+        inFlight_ = false;
+    }
+
+private:
+    static constexpr size_t kBatchSize = 16384;
+
+    struct Task {
+        Command::Kind kind;
+        uint64_t sequence;
+        Subscriber* subscriber;
+        uint64_t instrumentId;
+        Price lastTradedPrice;
+        Price extraValue;
+    };
+
+    /// One formatted response line inside a Stream.
+    struct Response {
+        uint64_t sequence;
+        size_t end;               // offset just past the line in Stream::text
+        Subscriber* subscriber;   // who asked; null for requests that never reached a subscriber
+        uint64_t instrumentId;
+        LookupStatus status;      // publisher's answer, before the quota is applied
+    };
+
+    /// Responses produced by one thread for one batch, in sequence order.
+    struct Stream {
+        OutputSink text{OutputSink::kMemory};
+        std::vector<Response> responses;
+    };
+
+    struct Batch {
+        std::vector<std::vector<Task>> tasks;  // per shard
+        std::vector<std::unique_ptr<Stream>> streams;  // per shard, plus one for the main thread
+    };
+
+    size_t shard_of(uint64_t instrumentId) const { return (instrumentId >> 6) % shardCount_; }
+
+    void route(Batch& batch, const Task& task) { batch.tasks[shard_of(task.instrumentId)].push_back(task); }
+
+    /**
+     * Hands the batch being filled to the workers. Two batches alternate:
+     * while workers process batch i, the main thread stitches the output
+     * of batch i-1 and then parses batch i+1 into the slot it just freed.
+     */
+    void launch(OutputSink& out) {
+        wait_idle();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            active_ = filling_;
+            ++generation_;
+            running_ = shardCount_;
+        }
+        start_.notify_all();
+
+        const size_t previous = 1 - filling_;
+        if (inFlight_) stitch(batches_[previous], out);
+        inFlight_ = true;
+        filling_ = previous;
+        batched_ = 0;
+    }
+
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&] { return running_ == 0; });
+    }
+
+    void run_worker(size_t shard) {
+        LatencyMonitor::Recorder* recorder = engine_.latency() ? &engine_.latency()->add_thread() : nullptr;
+        EngineMetrics::Counters& counters = engine_.metrics().add_thread();
+        uint64_t seenGeneration = 0;
+        for (;;) {
+            size_t active;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                start_.wait(lock, [&] { return stopping_ || generation_ != seenGeneration; });
+                if (stopping_) return;
+                seenGeneration = generation_;
+                active = active_;
+            }
+            if (recorder) {
+                execute_tasks_timed(batches_[active].tasks[shard], *batches_[active].streams[shard], counters,
+                                    *recorder);
+            } else {
+                execute_tasks(batches_[active].tasks[shard], *batches_[active].streams[shard], counters);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--running_ == 0) done_.notify_all();
+            }
+        }
+    }
+
+    /// Runs one shard's tasks. get_data outcomes are counted by stitch(), which applies the quota.
+    void execute_tasks(const std::vector<Task>& tasks, Stream& stream, EngineMetrics::Counters& counters) {
+        for (const Task& task : tasks) execute_task(task, stream, counters);
+    }
+
+    /// execute_tasks() with each task's publisher call recorded in `recorder`.
+    void execute_tasks_timed(const std::vector<Task>& tasks, Stream& stream, EngineMetrics::Counters& counters,
+                             LatencyMonitor::Recorder& recorder) {
+        using Operation = LatencyMonitor::Operation;
+        for (const Task& task : tasks) {
+            const Operation operation = task.kind == Command::Kind::Update      ? Operation::UpdateData
+                                        : task.kind == Command::Kind::Subscribe ? Operation::Subscribe
+                                                                                : Operation::GetData;
+            recorder.time(operation, engine_.publisher_index(task.instrumentId),
+                          [&] { execute_task(task, stream, counters); });
+        }
+    }
+
+    void execute_task(const Task& task, Stream& stream, EngineMetrics::Counters& counters) {
+        using Counter = EngineMetrics::Counter;
+        const uint64_t id = task.instrumentId;
+        switch (task.kind) {
+        case Command::Kind::Update: {
+            const bool applied = engine_.with_publisher(id, [&](auto& publisher) {
+                return publisher.update_data(id, task.lastTradedPrice, task.extraValue);
+            });
+            counters.add(applied ? Counter::UpdatesApplied : Counter::UpdatesRejected);
+            break;
+        }
+        case Command::Kind::Subscribe: {
+            const bool added = engine_.with_publisher(
+                id, [&](auto& publisher) { return publisher.subscribe(task.subscriber->handle(), id); });
+            counters.add(added ? Counter::SubscriptionsAdded : Counter::SubscriptionsRejected);
+            break;
+        }
+        case Command::Kind::GetData: {
+            Quote quote;
+            const LookupStatus status = engine_.with_publisher(
+                id, [&](const auto& publisher) { return publisher.lookup(task.subscriber->handle(), id, quote); });
+            task.subscriber->print_result(stream.text, status == LookupStatus::Ok, id, quote);
+            stream.responses.push_back({task.sequence, stream.text.contents().size(), task.subscriber, id, status});
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    /// Writes a processed batch's responses in sequence order and recycles its buffers.
+    void stitch(Batch& batch, OutputSink& out) {
+        const size_t streamCount = batch.streams.size();
+        std::vector<size_t>& cursor = cursors_;
+        cursor.assign(streamCount, 0);
+
+        for (;;) {
+            size_t next = streamCount;
+            uint64_t lowest = std::numeric_limits<uint64_t>::max();
+            for (size_t i = 0; i < streamCount; ++i) {
+                const auto& responses = batch.streams[i]->responses;
+                if (cursor[i] < responses.size() && responses[cursor[i]].sequence < lowest) {
+                    lowest = responses[cursor[i]].sequence;
+                    next = i;
+                }
+            }
+            if (next == streamCount) break;
+
+            const Stream& stream = *batch.streams[next];
+            const size_t index = cursor[next]++;
+            const Response& response = stream.responses[index];
+            if (Subscriber* subscriber = response.subscriber) {
+                // As in the serial path, an exhausted quota takes precedence over the lookup's own answer.
+                if (subscriber->quota_exhausted()) {
+                    engine_.count_get_data(*subscriber, LookupStatus::QuotaExhausted);
+                    if (response.status == LookupStatus::Ok) {
+                        subscriber->print_result(out, false, response.instrumentId, Quote());
+                        continue;
+                    }
+                } else {
+                    if (response.status == LookupStatus::Ok) subscriber->consume_request();
+                    engine_.count_get_data(*subscriber, response.status);
+                }
+            }
+            const size_t begin = index ? stream.responses[index - 1].end : 0;
+            out.append(stream.text.contents().substr(begin, response.end - begin));
+        }
+
+        for (auto& tasks : batch.tasks) tasks.clear();
+        for (auto& stream : batch.streams) {
+            stream->text.clear();
+            stream->responses.clear();
+        }
+    }
+
+    MarketDataEngine& engine_;
+    const size_t shardCount_;
+    std::vector<std::thread> workers_;
+    Batch batches_[2];
+    size_t filling_{0};      // batch the main thread is adding commands to
+    bool inFlight_{false};   // the other batch was launched and not yet stitched
+    size_t batched_{0};
+    uint64_t nextSequence_{0};
+    std::vector<size_t> cursors_;
+    std::vector<uint64_t> batchIds_;
+
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    uint64_t generation_{0};
+    size_t active_{0};       // batch the workers are processing
+    size_t running_{0};
+    bool stopping_{false};
+};
+
+#ifndef RAVEN_NO_MAIN  // defined by Q3-bench.cpp, which links its own main
+int main(int argc, char* argv[]) {
+    try {
+        const Options options = parse_options(argc, argv);
+        CommandInput input(options.inputPath);
+        OutputSink out;
+        out.set_binary_responses(options.binaryOutput);
+        if (options.encodeUpdates) {
+            input.set_idle_handler([&] { out.flush(); });
+            encode_updates(input, out);
+            out.flush();
+            return 0;
+        }
+
+        MarketDataEngine engine(options);
+
+        std::string_view line;
+        uint64_t numLines = 0;
+        LineFields fields;
+        if (input.next_line(line, fields)) parse_number(fields.get(line, 0), numLines);
+
+        if (options.shards > 1) {
+            ShardedEngine sharded(engine, options.shards, options.binaryOutput);
+            input.set_idle_handler([&] {
+                sharded.flush(out);
+                out.flush();
+            });
+            for (uint64_t i = 0; i < numLines && input.next_line(line, fields); ++i) {
+                sharded.submit(parse_command(line, fields), out);
+                out.maybe_flush();
+                engine.poll_latency_report();
+            }
+            sharded.flush(out);
+            input.set_idle_handler(nullptr);
+        } else {
+            input.set_idle_handler([&] {
+                if (options.pushMode) engine.deliver_pushes(out);
+                out.flush();
+            });
+            for (uint64_t i = 0; i < numLines && input.next_line(line, fields); ++i) {
+                engine.execute(parse_command(line, fields), out);
+                out.maybe_flush();
+                engine.poll_latency_report();
+            }
+            if (options.pushMode) engine.deliver_pushes(out);
+        }
+
+        out.flush();
+        if (engine.latency()) engine.latency()->report(std::cerr);
+    } catch (const std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}
+#endif